@@ -0,0 +1,122 @@
+#include "DetectionJournal.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace MultiDetectorSpace;
+
+static_assert(sizeof(JournalRecord) == 24, "The journal readers expect 24-byte records");
+static_assert(sizeof(JournalHeader) == 64, "The journal readers expect a 64-byte header");
+
+
+DetectionJournal::DetectionJournal() : Thread("CNN-ripple journal"), header(nullptr), records(nullptr), count(0), dropped(0)
+{
+}
+
+
+DetectionJournal::~DetectionJournal()
+{
+	close();
+}
+
+
+void DetectionJournal::close()
+{
+	stopThread(1000);
+
+	// What is still queued goes in before the file is unmapped
+	if (header != nullptr) flush();
+}
+
+
+bool DetectionJournal::open(const File& newFile, juce::uint64 capacity, double sampleRate)
+{
+	file = newFile;
+	std::size_t size = sizeof(JournalHeader) + std::size_t(capacity) * sizeof(JournalRecord);
+
+	// Written in full now, so the mapping never has to extend the file
+	std::vector<char> zeros(size, 0);
+	if (capacity == 0 || !file.replaceWithData(zeros.data(), size)) {
+		printf("Cannot create the detection journal %s\n", file.getFullPathName().toRawUTF8());
+		return false;
+	}
+
+	mapping = new MemoryMappedFile(file, MemoryMappedFile::readWrite);
+	if (mapping->getData() == nullptr || mapping->getSize() < size) {
+		printf("Cannot map the detection journal %s\n", file.getFullPathName().toRawUTF8());
+		mapping = nullptr;
+		return false;
+	}
+
+	header = static_cast<JournalHeader*>(mapping->getData());
+	records = reinterpret_cast<JournalRecord*>(static_cast<char*>(mapping->getData()) + sizeof(JournalHeader));
+	std::memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+	header->headerSize = sizeof(JournalHeader);
+	header->recordSize = sizeof(JournalRecord);
+	header->capacity = capacity;
+	header->sampleRate = sampleRate;
+	header->count = 0;
+
+	count = 0;
+	dropped = 0;
+	queue.reset(JOURNAL_QUEUE_SIZE, JournalRecord());
+
+	startThread();
+	return true;
+}
+
+
+bool DetectionJournal::add(const JournalRecord& record)
+{
+	if (!queue.push(record)) {
+		dropped++;
+		return false;
+	}
+	return true;
+}
+
+
+void DetectionJournal::run()
+{
+	while (!threadShouldExit()) {
+		flush();
+		wait(JOURNAL_FLUSH_INTERVAL);
+	}
+}
+
+
+void DetectionJournal::flush()
+{
+	JournalRecord record;
+	bool written = false;
+
+	while (queue.pop(record)) {
+		records[count % header->capacity] = record;
+		count++;
+		written = true;
+	}
+
+	if (written) {
+		// Readers of the live file see the records before the count that includes them
+		std::atomic_thread_fence(std::memory_order_release);
+		header->count = count;
+	}
+}
+
+
+juce::uint64 DetectionJournal::getCount() const
+{
+	return count;
+}
+
+
+unsigned int DetectionJournal::getDropped() const
+{
+	return dropped;
+}
+
+
+File DetectionJournal::getFile() const
+{
+	return file;
+}
@@ -0,0 +1,77 @@
+#ifndef DETECTIONJOURNAL_H_DEFINED
+#define DETECTIONJOURNAL_H_DEFINED
+
+#include <ProcessorHeaders.h>
+#include "SpscQueue.h"
+
+#define JOURNAL_MAGIC "CNNRJNL1"
+#define JOURNAL_QUEUE_SIZE 1024 // Detections waiting for the flush thread
+#define JOURNAL_FLUSH_INTERVAL 10 // ms between flushes
+
+namespace MultiDetectorSpace
+{
+	/** One detection as stored in the journal file, little endian. tools/read_journal.py reads the same layout */
+	struct JournalRecord
+	{
+		juce::int64 timestamp; // Sample of the TTL on edge
+		juce::int32 line; // TTL line
+		float probability; // Model output that made the detection
+		float drift; // Mean absolute z-score of the window, as compared with the drift threshold
+		float latency; // Run time of the model in microseconds, of the whole batch in Batch mode
+	};
+
+	/** First bytes of the journal file, followed by capacity records */
+	struct JournalHeader
+	{
+		char magic[8];
+		juce::uint32 headerSize;
+		juce::uint32 recordSize;
+		juce::uint64 capacity; // Records in the ring, the oldest are overwritten
+		double sampleRate; // Of the timestamps
+		juce::uint64 count; // Records written so far, the newest is at (count - 1) % capacity
+		char reserved[24];
+	};
+
+	/**
+	Fixed-size ring of detection records in a memory-mapped file.
+
+	The audio thread only copies a record into a queue slot. The flush thread moves the records into the mapping,
+	so page faults and write-back never happen in process(). The file is readable while it is being written: the
+	header count is updated after the records it covers.
+	*/
+	class DetectionJournal : public Thread
+	{
+	public:
+		DetectionJournal();
+		~DetectionJournal();
+
+		/** Creates the file with room for capacity records, replacing any previous one, and starts the flush
+		thread. Returns false on error. Not real-time safe */
+		bool open(const File& newFile, juce::uint64 capacity, double sampleRate);
+
+		/** Audio thread side. Returns false and counts the record as dropped if the queue is full */
+		bool add(const JournalRecord& record);
+
+		/** Stops the flush thread and writes what is still queued. Not real-time safe */
+		void close();
+
+		void run() override;
+
+		juce::uint64 getCount() const;
+		unsigned int getDropped() const;
+		File getFile() const;
+
+	private:
+		void flush();
+
+		File file;
+		ScopedPointer<MemoryMappedFile> mapping;
+		JournalHeader* header;
+		JournalRecord* records;
+		juce::uint64 count; // Owned by the flush thread until it stops
+		SpscQueue<JournalRecord> queue;
+		unsigned int dropped;
+	};
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "InferenceBackend.h"
+#include <cstdio>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+using namespace MultiDetectorSpace;
+
+
+void InferenceBackend::warmUp(int runs, int windowSteps, int maxWindows)
+{
+	if (runs <= 0) return;
+
+	std::vector<float> zeros(std::size_t(maxWindows) * windowSteps * getInputChannels(), 0.f);
+	std::vector<float> output(std::size_t(maxWindows) * getOutputSize(), 0.f);
+	std::vector<double> latencies;
+
+	warmingUp = true;
+
+	for (int run = 0; run < runs; run++) {
+		auto start = std::chrono::steady_clock::now();
+		infer(zeros.data(), 1, output.data());
+		latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// Every batch size is a different input shape, which may have its own lazy allocations
+	for (int windows = 2; windows <= maxWindows; windows++) {
+		infer(zeros.data(), windows, output.data());
+	}
+
+	warmingUp = false;
+
+	double cold = latencies[0];
+	if (coldLatency >= 0.) {
+		cold = coldLatency;
+	}
+	else if (latencies.size() > 1) {
+		latencies.erase(latencies.begin());
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%s warm-up: cold run %.1f us, warm run %.1f us (median of %d)\n", getName(), cold, latencies[latencies.size() / 2], int(latencies.size()));
+}
@@ -0,0 +1,59 @@
+#ifndef INFERENCEBACKEND_H_DEFINED
+#define INFERENCEBACKEND_H_DEFINED
+
+#include <string>
+
+namespace MultiDetectorSpace
+{
+	/**
+	Engine that runs the CNN on windows of [steps][channels] floats.
+
+	MultiDetector only talks to the model through this interface, so engines can be swapped per rig
+	without touching the detection logic.
+	*/
+	class InferenceBackend
+	{
+	public:
+		virtual ~InferenceBackend() {}
+
+		/** Name used in log messages */
+		virtual const char* getName() const = 0;
+
+		/** Loads the model from a SavedModel directory. Returns false on error */
+		virtual bool load(const std::string& modelPath) = 0;
+
+		/** Allocates everything needed to run up to maxWindows windows of windowSteps rows per call. Returns false on error */
+		virtual bool prepare(int windowSteps, int maxWindows) = 0;
+
+		/** Runs numWindows consecutive windows and writes getOutputSize() values per window to output. Returns false on error */
+		virtual bool infer(const float* windows, int numWindows, float* output) = 0;
+
+		/** Channels of each input row, from the model input shape. Valid after load() */
+		virtual int getInputChannels() const = 0;
+
+		/** Values per window written by infer(). Valid after prepare() */
+		virtual int getOutputSize() const = 0;
+
+		/** Folds the z-score normalization of the input channels into the model, so infer() and pushStream() take
+		raw samples. Returns false if the backend cannot, and the caller keeps normalizing the windows */
+		virtual bool setInputNormalization(const float*, const float*) { return false; }
+
+		/** Detection threshold, for backends that validate an approximation of the model against it */
+		virtual void setThreshold(float) {}
+
+		/** Incremental inference over a sliding window of the prepared length. Backends without it return false */
+		virtual bool startStream() { return false; }
+		virtual void resetStream() {}
+		virtual void pushStream(const float*) {}
+		virtual bool inferStream(float*) { return false; }
+
+		/** Runs dummy passes on zero windows (plus one per batch size) and prints the cold and warm latencies */
+		void warmUp(int runs, int windowSteps, int maxWindows);
+
+	protected:
+		bool warmingUp = false;   // Set during warmUp(), so backends can tell dummy windows from real ones
+		double coldLatency = -1.; // First run after load() in microseconds, when prepare() already had to run the model
+	};
+}
+
+#endif
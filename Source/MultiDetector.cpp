@@ -1,6 +1,16 @@
 #include "MultiDetector.h"
 #include "MultiDetectorEditor.h"
+#include "NativeBackend.h"
+#ifdef CNN_RIPPLE_TENSORFLOW
+#include "TensorFlowBackend.h"
+#endif
 #include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <chrono>
 
 
 #define MAX_PREDICT_BUFFER_SIZE 16
@@ -8,11 +18,59 @@
 #define SIGMOID_THRESH 0.84729786 //0.40565
 #define LOGIT(p) log(p/(1.-p))
 #define SIGMOID(x) 1./(1.+exp(-x))
+#define DECIMATED_BUFFER_SAMPLES 8192 // Input buffer length the decimated rows are allocated for, longer buffers grow them
+#define PREFILTER_LOW 100. // Ripple band of the prefilter, in Hz
+#define PREFILTER_HIGH 250.
+#define PREFILTER_ORDER 2
+#define PREFILTER_TIME_CONSTANT 0.008 // Smoothing of the band power envelope in seconds, about half a window
+#define PREFILTER_AUDIT_INTERVAL 16 // One in this many skipped windows runs anyway, to estimate the detections lost
 
 
 using namespace MultiDetectorSpace;
 
 
+namespace
+{
+	// The per-row loops are instantiated for the usual probe widths, so the channel loop is unrolled and vectorized.
+	// CHANNELS = 0 is the generic version, for any other channel count
+
+	template <int CHANNELS>
+	void normalizeRowsFixed(const float* rows, int numRows, int channels, const float* means, const float* invStds, float* out, float* rowMeans)
+	{
+		const int n = (CHANNELS > 0) ? CHANNELS : channels;
+		for (int idx = 0; idx < numRows; idx++, rows += n) {
+			float sum = 0.f;
+			if (out != nullptr) {
+				for (int chan = 0; chan < n; chan++) {
+					float value = (rows[chan] - means[chan]) * invStds[chan];
+					out[idx * n + chan] = value;
+					sum += value;
+				}
+			}
+			else if (rowMeans != nullptr) {
+				for (int chan = 0; chan < n; chan++) {
+					sum += (rows[chan] - means[chan]) * invStds[chan];
+				}
+			}
+			if (rowMeans != nullptr) rowMeans[idx] = std::abs(sum / n);
+		}
+	}
+
+	/** z-scores numRows consecutive rows into out and/or writes the absolute mean of each normalized row to rowMeans.
+	Either output can be nullptr, and out can be rows itself */
+	void normalizeRows(const float* rows, int numRows, int channels, const float* means, const float* invStds, float* out, float* rowMeans)
+	{
+		switch (channels) {
+		case 8: normalizeRowsFixed<8>(rows, numRows, channels, means, invStds, out, rowMeans); break;
+		case 16: normalizeRowsFixed<16>(rows, numRows, channels, means, invStds, out, rowMeans); break;
+		case 32: normalizeRowsFixed<32>(rows, numRows, channels, means, invStds, out, rowMeans); break;
+		case 64: normalizeRowsFixed<64>(rows, numRows, channels, means, invStds, out, rowMeans); break;
+		default: normalizeRowsFixed<0>(rows, numRows, channels, means, invStds, out, rowMeans); break;
+		}
+	}
+}
+
+
 MultiDetector::MultiDetector() : GenericProcessor("CNN-ripple")
 {
 	setProcessorType(PROCESSOR_TYPE_FILTER);
@@ -24,18 +82,70 @@ MultiDetector::MultiDetector() : GenericProcessor("CNN-ripple")
 	downsampleFactor = 1.0;
 	loopIndex = 0;
 	sinceLast = effectiveStride;
+	filterTaps = 0;
 
+	roundBuffer = nullptr;
+	roundBufferSize = 0;
+	roundBufferMask = 0;
 	roundBufferWriteIndex = 0;
-	roundBufferReadIndex = 0;
 	roundBufferNumElements = 0;
+	predictBuffer = nullptr;
 
 	modelPath = "";
 	modelLoaded = false;
+	acquiring = false;
+#ifdef CNN_RIPPLE_TENSORFLOW
+	backendType = BACKEND_TENSORFLOW;
+#else
+	backendType = BACKEND_NATIVE;
+#endif
+	outputSize = 0;
+	rawInput = false;
+	intraOpThreads = 1;
+	interOpThreads = 1;
+	perSessionThreads = false;
+	autoTuneSession = false;
+	warmUpRuns = 10;
+	streamingInference = false;
+	streamingActive = false;
+	asyncInference = false;
+	asyncNextTimestamp = 0;
+	droppedWindows = 0;
+	batchInference = false;
+	batchSize = 0;
+	rowsWritten = 0;
+	fusionMode = FUSION_OR;
+	prefilterFraction = 0.;
+	probabilityOutput = false;
+	probabilityChannel = -1;
+	numProbabilityTraces = 0;
+	std::fill(heldProbability, heldProbability + MAX_PROBABILITY_TRACES, 0.f);
+	journalEnabled = false;
+	dueLatency = 0.f;
+	earlyHorizon = 0.f;
+	earlyActive = false;
+	earlyHistorySize = 0;
+	earlyPending = false;
+	earlyTriggers = 0;
+	earlyConfirmed = 0;
+	earlyUnconfirmed = 0;
+	earlyLeadSum = 0.;
+	rippleEnvelope = 0.;
+	rippleBaseline = 0.;
+	prefilterAlpha = 1.;
+	prefilterWindows = 0;
+	prefilterGated = 0;
+	prefilterAudits = 0;
+	prefilterMisses = 0;
+	detectionCount = 0;
+	scalesActive = false;
+	mainProbability = NAN;
+	mainFresh = false;
+	maxWindowRows = predictBufferSize;
 
 	pulseDuration = 48.0;
 	timeout = 48.0;
 	nextSampleEnable = 0;
-	globalSample = 0;
 	forwardSamples = 0;
 
 	threshold1 = 0.5;
@@ -43,41 +153,32 @@ MultiDetector::MultiDetector() : GenericProcessor("CNN-ripple")
 	threshold2 = 0.5;
 	thresholdSign2 = 1;
 	inputLayer = "conv1d_input";
-	turnoffEvent1 = nullptr;
-	turnoffEvent2 = nullptr;
+	ttlWord = 0;
+	std::fill(ttlPulses, ttlPulses + NUM_TTL_LINES, 0);
+	droppedPulses = 0;
+	blockEventBuffer = nullptr;
+	ttlEventSize = 0;
+	ttlEventsPooled = false;
 
 	channel1 = -1;
 	channel2 = -1;
 
-	calibrationBuffer = std::vector<std::vector<float>>(NUM_CHANNELS);
 	calibrationTime = 60 * 1; // sec
-	elapsedCalibration = 0; // points
-	isCalibration = true;
-	channelsStds = std::vector<double>(NUM_CHANNELS);
-	channelsMeans = std::vector<double>(NUM_CHANNELS);
-	channelsNewStds = std::vector<double>(NUM_CHANNELS);
-	channelsNewMeans = std::vector<double>(NUM_CHANNELS);
-	channelsOldStds = std::vector<double>(NUM_CHANNELS);
-	channelsOldMeans = std::vector<double>(NUM_CHANNELS);
+	// Until a model is loaded, the channels of the original model
+	setNumChannels(8);
 
 	thrDrift = 0.;
 
-	for (int i = 0; i < NUM_CHANNELS; i++) {
-		calibrationBuffer[i] = std::vector<float>(calibrationTime * downsampledSamplingRate);
-		channelsMeans[i] = 0.;
-	}
-
 	createEventChannels();
 
-	printf("Sampling rate %f Downsample factor %d\n", samplingRate, downsampleFactor);
+	printf("Sampling rate %f Downsample factor %f\n", samplingRate, downsampleFactor);
 	printf("nInputs %d nOutputs %d\n", getNumInputs(), getNumOutputs());
 
 }
 
 MultiDetector::~MultiDetector()
 {
-	tf_functions::delete_graph(graph);
-	tf_functions::delete_session(session);
+	if (inferenceThread != nullptr) inferenceThread->stopThread(1000);
 }
 
 
@@ -97,7 +198,12 @@ bool MultiDetector::enable()
 	}
 	samplingRate = inChan->getSampleRate();
 
-	downsampleFactor = (unsigned int)samplingRate / downsampledSamplingRate;
+	// Not necessarily an integer, the input resampler holds the model rate for any source rate
+	downsampleFactor = samplingRate / downsampledSamplingRate;
+	if (downsampleFactor < 1) {
+		printf("The input rate must be at least %.0f Hz.\n", downsampledSamplingRate);
+		return false;
+	}
 	pulseDurationSamples = int(std::ceil(pulseDuration * samplingRate / 1000.0f));
 	timeoutSamples = int(std::floor(timeout * samplingRate / 1000.0f));
 	timeoutDownsampled = int(std::floor(timeoutSamples / downsampleFactor));
@@ -109,27 +215,406 @@ bool MultiDetector::enable()
 	}
 
 
-	// Restart round buffer
+	// Extra scales share the round buffer, which then holds the longest of their windows
+	scalesActive = scales.size() > 0 && !asyncInference && !batchInference;
+	if (scales.size() > 0 && !scalesActive) {
+		printf("Multi-scale detection only runs in Sync mode, the extra scales are off.\n");
+	}
+	maxWindowRows = predictBufferSize;
+	int maxStride = effectiveStride;
+	for (int idx = 0; scalesActive && idx < scales.size(); idx++) {
+		maxWindowRows = std::max<unsigned int>(maxWindowRows, scales[idx]->windowRows);
+		maxStride = std::max(maxStride, scales[idx]->stride);
+	}
+
+	// Restart round buffer. It holds a window plus the rows up to the next one, rounded up to a power of two so
+	// indices wrap with a mask. The first rows are mirrored after its end, so every window is one contiguous span
+	roundBufferSize = juce::nextPowerOfTwo(maxWindowRows + std::max(timeoutDownsampled, maxStride) + ROUND_BUFFER_HEADROOM);
+	roundBufferMask = roundBufferSize - 1;
+	std::size_t roundBufferValues = std::size_t(roundBufferSize + maxWindowRows) * numChannels;
+	std::size_t lineFloats = CACHE_LINE_SIZE / sizeof(float);
+	roundBufferStorage.assign(roundBufferValues + lineFloats, 0.f);
+	std::size_t misalignment = (reinterpret_cast<std::uintptr_t>(roundBufferStorage.data()) % CACHE_LINE_SIZE) / sizeof(float);
+	roundBuffer = roundBufferStorage.data() + (lineFloats - misalignment) % lineFloats;
+	roundBufferDrift.assign(roundBufferSize + maxWindowRows, 0.f);
+	windowDriftSum = 0.;
 	roundBufferWriteIndex = 0;
-	roundBufferReadIndex = 0;
 	roundBufferNumElements = 0;
 
 
-	predictBuffer = std::vector<float>(predictBufferSize * NUM_CHANNELS);
-	predictBufferSum = std::vector<float>(predictBufferSize);
+	// The model takes the first numChannels channels, they are chosen upstream (e.g. with a Channel Map)
+	if (getNumInputs() < numChannels) {
+		printf("The model expects %d channels, the input has %d.\n", numChannels, getNumInputs());
+		return false;
+	}
+
+	if (!backend->prepare(predictBufferSize, (batchInference && !asyncInference) ? MAX_BATCH_SIZE : 1)) {
+		printf("Can't prepare the %s backend.\n", backend->getName());
+		return false;
+	}
+	backend->setThreshold(threshold1);
+
+	for (int idx = 0; scalesActive && idx < scales.size(); idx++) {
+		DetectionScale* scale = scales[idx];
+		if (!scale->backend->prepare(scale->windowRows, 1)) {
+			printf("Can't prepare the %s backend of scale %d.\n", scale->backend->getName(), idx + 1);
+			return false;
+		}
+		scale->backend->setThreshold(threshold1);
+		scale->output.assign(scale->backend->getOutputSize(), 0.f);
+		scale->sinceLast = scale->stride;
+		scale->driftSum = 0.;
+		scale->probability = NAN;
+		scale->fresh = false;
+	}
+	mainProbability = NAN;
+	mainFresh = false;
+
+	// A previous acquisition may have finished the calibration already
+	rawInput = false;
+	if (isCalibration == false) updateInputNormalization();
+	outputSize = backend->getOutputSize();
+	modelOutput.assign(outputSize, 0.f);
+
+	// Synchronous windows are run from the round buffer, the other modes set where windows are copied to
+	predictBuffer = nullptr;
+
+	// The stream is fed by process(), so it is not used when windows are run elsewhere
+	streamingActive = streamingInference && !asyncInference && !batchInference && backend->startStream();
+
+	if (batchInference && !asyncInference) {
+		// Windows are built on consecutive slots and run together by flushBatch
+		batchWindows.assign(MAX_BATCH_SIZE * predictBufferSize * numChannels, 0.f);
+		batchOutputs.assign(MAX_BATCH_SIZE * outputSize, 0.f);
+		batchSize = 0;
+		rowsWritten = 0;
+		predictBuffer = batchWindows.data();
+	}
 
+	backend->warmUp(warmUpRuns, predictBufferSize, (batchInference && !asyncInference) ? MAX_BATCH_SIZE : 1);
+	for (int idx = 0; scalesActive && idx < scales.size(); idx++) {
+		scales[idx]->backend->warmUp(warmUpRuns, scales[idx]->windowRows, 1);
+	}
+
+	// Anti-aliasing filter in front of the round buffer. Its group delay adds to the detection latency
+	if (dsp_functions::create_resampler(downsampleFactor, filterTaps, numChannels, &inputResampler) != 0) {
+		return false;
+	}
+	inputResampler.use_simd = cnn_functions::cpu_supports_simd();
+	decimatedRows.assign((int(DECIMATED_BUFFER_SAMPLES / downsampleFactor) + 1) * numChannels, 0.f);
+	decimatedSamples.assign(int(DECIMATED_BUFFER_SAMPLES / downsampleFactor) + 1, 0);
+	printf("Input filter: %d taps, %d phases, group delay %.2f ms\n", inputResampler.num_taps, inputResampler.num_phases,
+		1000. * dsp_functions::resampler_delay(inputResampler) / samplingRate);
+
+	// The ripple-band power always runs, so the baseline is calibrated even while the prefilter is off
+	if (dsp_functions::create_band_filter(PREFILTER_LOW, PREFILTER_HIGH, downsampledSamplingRate, PREFILTER_ORDER, numChannels, &rippleFilter) != 0) {
+		return false;
+	}
+	rippleFilter.use_simd = cnn_functions::cpu_supports_simd();
+	ripplePower.assign(int(DECIMATED_BUFFER_SAMPLES / downsampleFactor) + 1, 0.f);
+	prefilterAlpha = 1. - std::exp(-1. / (PREFILTER_TIME_CONSTANT * downsampledSamplingRate));
+	rippleEnvelope = 0.;
+	prefilterWindows = 0;
+	prefilterGated = 0;
+	prefilterAudits = 0;
+	prefilterMisses = 0;
+	detectionCount = 0;
+
+	ttlScheduler.reset(TTL_PENDING_TRANSITIONS, 8, 256, 0);
+	ttlWord = 0;
+	std::fill(ttlPulses, ttlPulses + NUM_TTL_LINES, 0);
+	droppedPulses = 0;
+	ttlEventsPooled = prepareTtlEvents();
+	if (!ttlEventsPooled) {
+		printf("Unexpected TTL event layout, events are created for each detection.\n");
+	}
+
+	std::fill(heldProbability, heldProbability + MAX_PROBABILITY_TRACES, 0.f);
+	probabilityUpdates.clear();
+	probabilityUpdates.reserve(int(DECIMATED_BUFFER_SAMPLES / downsampleFactor) + 1);
+
+	// Early trigger, it needs the probabilities of consecutive windows as they come
+	earlyActive = earlyHorizon > 0 && !asyncInference && !batchInference && !scalesActive;
+	if (earlyHorizon > 0 && !earlyActive) {
+		printf("The early trigger only runs in Sync mode without extra scales, it is off.\n");
+	}
+	earlyHorizonSamples = juce::int64(std::floor(earlyHorizon * samplingRate / 1000. + 0.5));
+	earlyStrideSamples = juce::int64(std::ceil(effectiveStride * downsampleFactor));
+	earlyHistorySize = 0;
+	earlyPending = false;
+	earlyTriggers = 0;
+	earlyConfirmed = 0;
+	earlyUnconfirmed = 0;
+	earlyLeadSum = 0.;
+
+	if (journalEnabled) {
+		File journalFile = CoreServices::getDefaultUserSaveDirectory().getChildFile("CNN-ripple_" + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S") + ".journal");
+		journal = new DetectionJournal();
+		if (!journal->open(journalFile, JOURNAL_CAPACITY, samplingRate)) {
+			journal = nullptr;
+		}
+	}
+
+	if (asyncInference) {
+		// Windows are built on the request and handed to the inference thread, which owns the model
+		asyncRequest.timestamp = 0;
+		asyncRequest.drift = 0.f;
+		asyncRequest.window.assign(predictBufferSize * numChannels, 0.f);
+		asyncResult.timestamp = 0;
+		asyncResult.drift = 0.f;
+		asyncResult.latency = 0.f;
+		asyncResult.outputs.assign(outputSize, 0.f);
+		workerRequest = asyncRequest;
+		workerResult = asyncResult;
+
+		requestQueue.reset(ASYNC_QUEUE_SIZE, asyncRequest);
+		resultQueue.reset(ASYNC_QUEUE_SIZE, asyncResult);
+		predictBuffer = asyncRequest.window.data();
+		asyncNextTimestamp = 0;
+		droppedWindows = 0;
+
+		inferenceThread = new InferenceThread(this);
+		inferenceThread->startThread();
+	}
+
+	acquiring = true;
 	return true;
 }
 
 
 bool MultiDetector::disable()
 {
-	// TODO
+	acquiring = false;
+
+	if (inferenceThread != nullptr) {
+		inferenceThread->stopThread(1000);
+		inferenceThread = nullptr;
+
+		if (droppedWindows > 0) printf("Inference queue full, %u windows dropped\n", droppedWindows);
+	}
+
+	if (droppedPulses > 0) printf("TTL queue full, %u pulses dropped\n", droppedPulses);
+
+	if (earlyTriggers > 0) {
+		// An early pulse without a crossing after it is at most one false positive more than the threshold alone
+		printf("Early trigger: %u of %u detections were early. %u were confirmed by a crossing within %.1f ms, %.2f ms before it on average. "
+			"%u were not, at most %.1f%% more false positives\n", earlyTriggers, detectionCount, earlyConfirmed, earlyHorizon,
+			earlyConfirmed > 0 ? 1000. * earlyLeadSum / earlyConfirmed / samplingRate : 0., earlyUnconfirmed,
+			(detectionCount > earlyUnconfirmed) ? 100. * earlyUnconfirmed / (detectionCount - earlyUnconfirmed) : 0.);
+	}
+
+	if (journal != nullptr) {
+		journal->close();
+		printf("Detection journal: %llu detections in %s, %u dropped\n", (unsigned long long) journal->getCount(),
+			journal->getFile().getFullPathName().toRawUTF8(), journal->getDropped());
+		journal = nullptr;
+	}
+
+	if (prefilterWindows > 0) {
+		// Each audited window stands for PREFILTER_AUDIT_INTERVAL skipped ones
+		double lost = double(prefilterMisses) * PREFILTER_AUDIT_INTERVAL;
+		printf("Ripple prefilter: %u of %u windows skipped (%.1f%%). %u of %u audited skipped windows would have detected, estimated recall loss %.1f%%\n",
+			prefilterGated, prefilterWindows, 100. * prefilterGated / prefilterWindows, prefilterMisses, prefilterAudits,
+			(detectionCount + lost > 0) ? 100. * lost / (detectionCount + lost) : 0.);
+	}
 
 	return true;
 }
 
 
+InferenceThread::InferenceThread(MultiDetector* detector) : Thread("CNN-ripple inference"), detector(detector)
+{
+}
+
+void InferenceThread::run()
+{
+	while (!threadShouldExit()) {
+		// process() wakes the thread after each window it queues, and stopThread() to exit
+		if (!detector->requestQueue.pop(detector->workerRequest)) {
+			wait(-1);
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		const float* outputs = detector->runModel(detector->workerRequest.window.data());
+
+		detector->workerResult.timestamp = detector->workerRequest.timestamp;
+		detector->workerResult.drift = detector->workerRequest.drift;
+		detector->workerResult.latency = float(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		std::copy(outputs, outputs + detector->workerResult.outputs.size(), detector->workerResult.outputs.begin());
+
+		// process() drains the results every buffer, so a full queue only waits for the next one
+		while (!detector->resultQueue.push(detector->workerResult) && !threadShouldExit()) {
+			wait(1);
+		}
+	}
+}
+
+
+InferenceBackend* MultiDetector::createBackend(int windowSteps)
+{
+	switch (backendType) {
+	case BACKEND_TENSORFLOW:
+	{
+#ifdef CNN_RIPPLE_TENSORFLOW
+		tf_functions::session_options options;
+		options.intra_op_threads = intraOpThreads;
+		options.inter_op_threads = interOpThreads;
+		options.use_per_session_threads = perSessionThreads;
+		return new TensorFlowBackend(inputLayer.toStdString(), options, autoTuneSession, windowSteps);
+#else
+		printf("Plugin built without TensorFlow support.\n");
+		return nullptr;
+#endif
+	}
+	case BACKEND_NATIVE: return new NativeBackend(true, false);
+	case BACKEND_NATIVE_INT8: return new NativeBackend(true, true);
+	case BACKEND_REFERENCE: return new NativeBackend(false, false);
+	default: return nullptr;
+	}
+}
+
+
+void MultiDetector::setNumChannels(int newNumChannels)
+{
+	numChannels = newNumChannels;
+	channelsData.assign(numChannels, nullptr);
+
+	// The statistics of other channels are no use, calibration starts over
+	isCalibration = true;
+	elapsedCalibration = 0;
+	channelsStds.assign(numChannels, 1.);
+	channelsMeans.assign(numChannels, 0.);
+	channelsNewStds.assign(numChannels, 0.);
+	channelsNewMeans.assign(numChannels, 0.);
+	channelsOldStds.assign(numChannels, 0.);
+	channelsOldMeans.assign(numChannels, 0.);
+	normMeans.assign(numChannels, 0.f);
+	normInvStds.assign(numChannels, 1.f);
+}
+
+
+void MultiDetector::updateInputNormalization()
+{
+	std::vector<float> stds(numChannels);
+	for (int chan = 0; chan < numChannels; chan++) {
+		normMeans[chan] = channelsMeans[chan];
+		normInvStds[chan] = 1. / channelsStds[chan];
+		stds[chan] = channelsStds[chan];
+	}
+
+	rawInput = backend->setInputNormalization(normMeans.data(), stds.data());
+
+	// Scales run on the same engine, so they fold the z-score whenever the main model does
+	for (int idx = 0; rawInput && idx < scales.size(); idx++) {
+		scales[idx]->backend->setInputNormalization(normMeans.data(), stds.data());
+	}
+}
+
+
+const float* MultiDetector::runModel(const float* window)
+{
+	backend->infer(window, 1, modelOutput.data());
+	return modelOutput.data();
+}
+
+
+const float* MultiDetector::runModelBatch(int numWindows)
+{
+	backend->infer(batchWindows.data(), numWindows, batchOutputs.data());
+	return batchOutputs.data();
+}
+
+
+void MultiDetector::handleAsyncResults(uint64 bufferTs, int bufferNumSamples)
+{
+	while (resultQueue.pop(asyncResult)) {
+		// The window ended in a previous buffer, so the event goes out as early as possible in this one
+		int sample = juce::jlimit(0, bufferNumSamples - 1, int(asyncResult.timestamp - juce::int64(bufferTs)));
+		const float* tensor_data = asyncResult.outputs.data();
+		publishProbability(sample, tensor_data);
+
+		// Skip windows that were queued before an event was found but fall inside its timeout
+		if (asyncResult.timestamp < asyncNextTimestamp) continue;
+		bool eventFound = false;
+
+		if ((thresholdSign1 * tensor_data[0]) >= (thresholdSign1 * threshold1) && channel1 >= 0) {
+			eventFound = true;
+			detectionCount++;
+			sendTTLEvent(bufferTs, sample, channel1);
+			journalDetection(bufferTs + sample, channel1, tensor_data[0], asyncResult.drift, asyncResult.latency);
+		}
+
+		if (outputSize > 2 && (thresholdSign2 * tensor_data[2]) >= (thresholdSign2 * threshold2) && channel2 >= 0) {
+			eventFound = true;
+			sendTTLEvent(bufferTs, sample, channel2);
+			journalDetection(bufferTs + sample, channel2, tensor_data[2], asyncResult.drift, asyncResult.latency);
+		}
+
+		if (eventFound) {
+			asyncNextTimestamp = asyncResult.timestamp + timeoutSamples;
+		}
+	}
+}
+
+
+void MultiDetector::flushBatch(uint64 bufferTs)
+{
+	auto start = std::chrono::steady_clock::now();
+	const float* outputs = runModelBatch(batchSize);
+	float latency = float(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+	// Every window of the batch comes before the timeout of the first one ends, so after an event the rest of
+	// them fall inside its timeout and are dropped, as Sync mode would never have run them
+	int eventWindow = -1;
+
+	for (int b = 0; b < batchSize && eventWindow < 0; b++) {
+		const float* tensor_data = outputs + b * outputSize;
+		publishProbability(batchSamples[b], tensor_data);
+		forwardSamples = 0;
+
+		// Event 0
+		if ((thresholdSign1 * tensor_data[0]) >= (thresholdSign1 * threshold1) && channel1 >= 0) {
+			forwardSamples = 1;
+			detectionCount++;
+			sendTTLEvent(bufferTs, batchSamples[b], channel1);
+			journalDetection(bufferTs + batchSamples[b], channel1, tensor_data[0], batchDrift[b], latency);
+		}
+
+		// Event 2
+		if (outputSize > 2 && (thresholdSign2 * tensor_data[2]) >= (thresholdSign2 * threshold2) && channel2 >= 0) {
+			forwardSamples = 1;
+			sendTTLEvent(bufferTs, batchSamples[b], channel2);
+			journalDetection(bufferTs + batchSamples[b], channel2, tensor_data[2], batchDrift[b], latency);
+		}
+
+		if (forwardSamples == 1) eventWindow = b;
+	}
+
+	// The rows saved so far do not reach the end of the timeout, so the next window is placed from the event
+	// window exactly as in Sync mode
+	if (eventWindow >= 0) {
+		nextSampleEnable = batchSamples[eventWindow] + timeoutSamples;
+		sinceLast = (unsigned int)(rowsWritten - batchRows[eventWindow]);
+	}
+
+	batchSize = 0;
+	predictBuffer = batchWindows.data();
+}
+
+
+void MultiDetector::processBlock(AudioSampleBuffer& buffer, MidiBuffer& eventBuffer)
+{
+	// Only grows on the first blocks, the buffer keeps its memory when it is cleared
+	eventBuffer.ensureSize(EVENT_BUFFER_RESERVE);
+	blockEventBuffer = &eventBuffer;
+
+	GenericProcessor::processBlock(buffer, eventBuffer);
+
+	blockEventBuffer = nullptr;
+}
+
+
 void MultiDetector::process(AudioSampleBuffer& buffer)
 {
 	/**
@@ -137,8 +622,6 @@ void MultiDetector::process(AudioSampleBuffer& buffer)
 	If spike processing is also needing, set the argument to true
 	*/
 	//checkForEvents(false);
-	int numChannels = buffer.getNumChannels();
-	// TODO: check that numChannels >= 8
 
 	// We use this instead of buffer.getNumSamples() because the second returns all the buffer positions,
 	// even the empty ones. The first just gives the number of used positions.
@@ -153,187 +636,617 @@ void MultiDetector::process(AudioSampleBuffer& buffer)
 		return;
 	}
 
+	if (buffer.getNumChannels() < numChannels) {
+		printf("The model expects %d channels, the buffer has %d.\n", numChannels, buffer.getNumChannels());
+		return;
+	}
+
 
 	//std::cout << "samples: " << numSamples << " time: " << ts << " fs: " << samplingRate << " factor: " << downsampleFactor << " nextSampleEnable: " << nextSampleEnable << std::endl;
 
 
 	// Gets pointers to buffers
-	const float* channelsData[NUM_CHANNELS];
-	for (int chan = 0; chan < NUM_CHANNELS; chan++) {
+	for (int chan = 0; chan < numChannels; chan++) {
 		channelsData[chan] = buffer.getReadPointer(chan);
 	}
 
 
-	// Sends TTL events that were stored from previous buffers if its time
-	int turnoffOffset1 = turnoffEvent1 ? juce::jmax(0, int(turnoffEvent1->getTimestamp() - tsBuffer)) : -1;
-	if (turnoffOffset1 >= 0 && turnoffOffset1 < numSamples) {
-		addEvent(ttlEventChannel, turnoffEvent1, turnoffOffset1);
-		turnoffEvent1 = nullptr;
+	if (asyncInference) {
+		handleAsyncResults(tsBuffer, numSamples);
 	}
 
-	int turnoffOffset2 = turnoffEvent2 ? juce::jmax(0, int(turnoffEvent2->getTimestamp() - tsBuffer)) : -1;
-	if (turnoffOffset2 >= 0 && turnoffOffset2 < numSamples) {
-		addEvent(ttlEventChannel, turnoffEvent2, turnoffOffset2);
-		turnoffEvent2 = nullptr;
+
+	// Low-pass and resample the whole buffer first, each row ends at one of its samples
+	std::size_t maxDecimated = std::size_t(numSamples / downsampleFactor) + 1;
+	if (decimatedSamples.size() < maxDecimated) {
+		decimatedRows.resize(maxDecimated * numChannels);
+		decimatedSamples.resize(maxDecimated);
 	}
+	std::size_t numDecimated = dsp_functions::run_resampler(&inputResampler, channelsData.data(), numSamples, decimatedRows.data(), decimatedSamples.data());
+	std::size_t writtenRows = 0;
+
+	// Only the samples where a window is due are visited, the rows before each of them are written in one go
+	while (true) {
+		// The first window due, of the main one or any scale
+		std::size_t neededRows = rowsNeeded(predictBufferSize, effectiveStride, sinceLast);
+		for (int idx = 0; scalesActive && idx < scales.size(); idx++) {
+			neededRows = std::min<std::size_t>(neededRows, rowsNeeded(scales[idx]->windowRows, scales[idx]->stride, scales[idx]->sinceLast));
+		}
 
+		// Due when the last needed row comes, but not before the timeout of the last event
+		int sample = -1;
+		if (writtenRows + neededRows <= numDecimated) {
+			sample = (neededRows > 0) ? int(decimatedSamples[writtenRows + neededRows - 1]) : 0;
+			sample = std::max(sample, nextSampleEnable);
+		}
+		bool due = sample >= 0 && sample < numSamples;
 
-	for (int sample = 0; sample < numSamples; sample++, globalSample++) {
+		// Pending windows are run before the rows reach the timeout of the first one, an event among them
+		// moves the next window
+		if (batchSize > 0 && (!due || sample >= batchSamples[0] + timeoutSamples)) {
+			flushBatch(tsBuffer);
+			continue;
+		}
+		if (!due) break;
 
-		// Save sample in round buffer
-		if (globalSample % downsampleFactor == 0) {
-			// Use globalSample so it is not relative to the buffer
-			globalSample = 0;
+		std::size_t rowsUntilSample = writtenRows + neededRows;
+		while (rowsUntilSample < numDecimated && decimatedSamples[rowsUntilSample] <= std::size_t(sample)) rowsUntilSample++;
 
-			if (isCalibration == true) {
+		writeRows(decimatedRows.data() + writtenRows * numChannels, rowsUntilSample - writtenRows);
+		writtenRows = rowsUntilSample;
+		dueLatency = 0.f;
 
-				elapsedCalibration++;
+		if (rowsNeeded(predictBufferSize, effectiveStride, sinceLast) == 0) {
+			predictWindow(tsBuffer, sample);
+		}
+		if (scalesActive) {
+			predictScales(sample);
+			fuseDetections(tsBuffer, sample);
+		}
+	}
 
-				for (int chan = 0; chan < NUM_CHANNELS; chan++) {
-					//calibrationBuffer[chan][elapsedCalibration-1] = channelsData[chan][sample];
-					//channelsMeans[chan] += channelsData[chan][sample];
-					pushMeanStd(channelsData[chan][sample], chan);
-				}
+	writeRows(decimatedRows.data() + writtenRows * numChannels, numDecimated - writtenRows);
 
-				if (elapsedCalibration >= (calibrationTime * downsampledSamplingRate)) {
-					isCalibration = false;
-					for (int chan = 0; chan < NUM_CHANNELS; chan++) {
-						//channelsMeans[chan] /= calibrationBuffer[chan].size();
-						//channelsStds[chan] = calculateStd(calibrationBuffer[chan], channelsMeans[chan]);
-						//if (channelsStds[chan] == 0) channelsStds[chan] = 1;
-						channelsMeans[chan] = getMean(chan);
-						channelsStds[chan] = getStd(chan);
-					}
-				}
-			}
+	// Pulse edges of this buffer, including the ends of pulses started in previous ones
+	sendPendingEvents(tsBuffer, numSamples);
+
+	writeProbabilityTraces(buffer, numSamples);
+
+	// Shift nextSampleEnable so it is relative to the next buffer
+	nextSampleEnable = juce::jmax(0, nextSampleEnable - numSamples);
+}
+
+
+void MultiDetector::writeRows(const float* rows, std::size_t numRows)
+{
+	std::size_t firstCalibratedRow = 0;
+	bool wasCalibration = isCalibration;
+
+	if (ripplePower.size() < numRows) ripplePower.resize(numRows);
+	dsp_functions::run_band_filter(&rippleFilter, rows, numRows, ripplePower.data());
+
+	// Calibration goes row by row until it ends, the row that ends it is the first one normalized
+	for (std::size_t row = 0; row < numRows && isCalibration == true; row++) {
+		elapsedCalibration++;
 
-			for (int chan = 0; chan < NUM_CHANNELS; chan++) {
-				roundBuffer[roundBufferWriteIndex][chan] = channelsData[chan][sample];
+		for (int chan = 0; chan < numChannels; chan++) {
+			pushMeanStd(rows[row * numChannels + chan], chan);
+		}
+		rippleBaseline = (elapsedCalibration == 1) ? ripplePower[row] : rippleBaseline + (ripplePower[row] - rippleBaseline) / elapsedCalibration;
+
+		if (elapsedCalibration >= (calibrationTime * downsampledSamplingRate)) {
+			isCalibration = false;
+			for (int chan = 0; chan < numChannels; chan++) {
+				channelsMeans[chan] = getMean(chan);
+				channelsStds[chan] = getStd(chan);
 			}
 
-			roundBufferWriteIndex = (roundBufferWriteIndex + 1) % MAX_ROUND_BUFFER_SIZE;
-			if (roundBufferNumElements < predictBufferSize) roundBufferNumElements++;
-			sinceLast++;
+			updateInputNormalization();
+
+			// The stream only holds rows normalized with the final calibration
+			if (streamingActive) backend->resetStream();
 		}
+		firstCalibratedRow = row + (isCalibration ? 1 : 0);
+	}
 
-		//std::cout << "sinceLast: " << sinceLast << " nextSampleEnable: " << nextSampleEnable << std::endl;
+	for (std::size_t row = 0; row < numRows; row++) {
+		rippleEnvelope += prefilterAlpha * (ripplePower[row] - rippleEnvelope);
+	}
 
-		// Check if it is time to predict (enough data AND effective stride passed AND timeout passed)
-		if ((roundBufferNumElements >= predictBufferSize) && (sinceLast >= effectiveStride) && (sample >= nextSampleEnable)) {
-			//std::cout << "sinceLast: " << sinceLast << " elapsedCalibration: " << elapsedCalibration << std::endl;
-			sinceLast = 0;
-			nextSampleEnable = sample + 1;
+	// Calibration rows are saved as they come. When it ends they are normalized in place, and every row after
+	// that is saved as the model takes it
+	writeRoundBuffer(rows, firstCalibratedRow, false);
+	if (wasCalibration && isCalibration == false) normalizeRoundBuffer();
+	writeRoundBuffer(rows + firstCalibratedRow * numChannels, numRows - firstCalibratedRow, true);
+
+	roundBufferNumElements = std::min<std::size_t>(maxWindowRows, roundBufferNumElements + numRows);
+	rowsWritten += numRows;
+	sinceLast += numRows;
+	for (int idx = 0; idx < scales.size(); idx++) {
+		scales[idx]->sinceLast += numRows;
+	}
+}
 
-			//std::cout << "Sample: " << sample << " Downsample: " << sample/downsampleFactor << " Time: " << (unsigned int)(1000.f * float(tsBuffer + sample) / samplingRate) << std::endl;
-			//std::cout << "Write: " << roundBufferWriteIndex << " Read: " << roundBufferReadIndex << std::endl;
 
-			unsigned int temporalReadIndex = roundBufferReadIndex;
-			unsigned int oldRoundBufferReadIndex = roundBufferReadIndex;
-			// Next value to read will be the first upcoming window after stride, if no event is found
-			roundBufferReadIndex = (oldRoundBufferReadIndex + effectiveStride) % MAX_ROUND_BUFFER_SIZE;
+int MultiDetector::rowsNeeded(unsigned int windowRows, int stride, unsigned int rowsSinceLast)
+{
+	// Rows still needed for a full window and a stride since the last one
+	return std::max(0, std::max(int(windowRows) - int(roundBufferNumElements), stride - int(rowsSinceLast)));
+}
 
-			// If still calibrating do nothing yet
-			if (isCalibration == true) continue;
 
-			// Create predict window
-			for (int idx = 0; idx < predictBufferSize; idx++) {
-				for (int chan = 0; chan < NUM_CHANNELS; chan++) {
-					// Save in the buffer after z-score norm. It is done here because the mean and std are already calculated
-					predictBuffer[(idx * NUM_CHANNELS) + chan] = (roundBuffer[temporalReadIndex][chan] - channelsMeans[chan]) / channelsStds[chan];
-					predictBufferSum[idx] += predictBuffer[(idx * NUM_CHANNELS) + chan];
-				}
-				predictBufferSum[idx] = abs(predictBufferSum[idx]/NUM_CHANNELS);
-				temporalReadIndex = (temporalReadIndex + 1) % MAX_ROUND_BUFFER_SIZE;
+void MultiDetector::writeRoundBuffer(const float* rows, std::size_t numRows, bool calibrated)
+{
+	// In pieces that end where they wrap around
+	while (numRows > 0) {
+		unsigned int index = roundBufferWriteIndex;
+		std::size_t pieceRows = std::min<std::size_t>(numRows, roundBufferSize - index);
+		float* dest = &roundBuffer[index * numChannels];
+		float* drift = &roundBufferDrift[index];
+
+		if (calibrated && !rawInput) {
+			normalizeRows(rows, pieceRows, numChannels, normMeans.data(), normInvStds.data(), dest, drift);
+		}
+		else {
+			std::copy(rows, rows + pieceRows * numChannels, dest);
+			if (calibrated) normalizeRows(rows, pieceRows, numChannels, normMeans.data(), normInvStds.data(), nullptr, drift);
+		}
+
+		// Slide the drift sum over the newest predictBufferSize rows, each new row pushes out the one
+		// predictBufferSize rows before it (which may be a new one too, if the piece is longer than a window)
+		if (calibrated) {
+			for (std::size_t row = 0; row < pieceRows; row++) {
+				windowDriftSum += drift[row] - roundBufferDrift[(index + row - predictBufferSize) & roundBufferMask];
 			}
-			// If drift threshold is bigger than 0 then check the channels absolute mean
-			if (thrDrift > 0) {
-				skipPrediction = true;
-				float meanWindow = 0;
-				for (int idx = 0; idx < predictBufferSize; idx++) {
-					meanWindow += predictBufferSum[idx];
-					predictBufferSum[idx] = 0;
-				}
-				//for (int chan = 0; chan < NUM_CHANNELS; chan++) {
-				//	float meanChan += predictBufferSum[chan] ;
-				//	predictBufferSum[chan] = 0;
-
-					// If just one channel is under the threshold then perform prediction
-				//	if (meanChan < (channelsMeans[chan] + (thrDrift * channelsStds[chan]))) {
-				//		skipPrediction = false;
-				//		break;
-				//	}
-				//}
-				meanWindow = meanWindow/(predictBufferSize);
-				if (meanWindow < thrDrift) {
-					skipPrediction = false;
+			for (int idx = 0; scalesActive && idx < scales.size(); idx++) {
+				DetectionScale* scale = scales[idx];
+				for (std::size_t row = 0; row < pieceRows; row++) {
+					scale->driftSum += drift[row] - roundBufferDrift[(index + row - scale->windowRows) & roundBufferMask];
 				}
 			}
+		}
 
+		// The stream takes the rows as saved, normalized or raw as the model takes them
+		if (calibrated && streamingActive) {
+			for (std::size_t row = 0; row < pieceRows; row++) {
+				backend->pushStream(dest + row * numChannels);
+			}
+		}
 
-			//Predict
-			if (skipPrediction == false) {
-				/*FILE * f = fopen("salida4.txt", "a");
+		// Rows under maxWindowRows are also written after the end, where the windows that wrap around continue
+		if (index < maxWindowRows) {
+			std::size_t mirrorRows = std::min<std::size_t>(pieceRows, maxWindowRows - index);
+			std::copy(dest, dest + mirrorRows * numChannels, &roundBuffer[(roundBufferSize + index) * numChannels]);
+			std::copy(&roundBufferDrift[index], &roundBufferDrift[index + mirrorRows], &roundBufferDrift[roundBufferSize + index]);
+		}
 
-				for (int idx = 0; idx < predictBufferSize; idx++) {
-					fprintf(f, "%f ", predictBuffer[(idx * NUM_CHANNELS) + 0]);
-				}
-				fprintf(f, "\n");
-				fclose(f);*/
+		rows += pieceRows * numChannels;
+		numRows -= pieceRows;
+		roundBufferWriteIndex = (index + pieceRows) & roundBufferMask;
+	}
+}
 
-				TF_Tensor* input_tensor = nullptr, * output_tensor = nullptr;
 
+void MultiDetector::normalizeRoundBuffer()
+{
+	// Mirrored rows hold the same samples, so the whole buffer is done in one pass
+	float* rows = roundBuffer;
+	int numRows = roundBufferSize + maxWindowRows;
 
-				std::vector<std::int64_t> dims = { 1, predictBufferSize, NUM_CHANNELS };
-				int num_dims = 3;
-				tf_functions::create_tensor(TF_FLOAT, dims, num_dims, predictBuffer, &input_tensor);
+	normalizeRows(rows, numRows, numChannels, normMeans.data(), normInvStds.data(), rawInput ? nullptr : rows, roundBufferDrift.data());
 
-				tf_functions::run_session(session, &input, &input_tensor, 1, &output, &output_tensor, 1);
+	// From here on the drift sums slide as rows are saved
+	windowDriftSum = sumDrift(predictBufferSize);
+	for (int idx = 0; scalesActive && idx < scales.size(); idx++) {
+		scales[idx]->driftSum = sumDrift(scales[idx]->windowRows);
+	}
+}
 
-				// Check results
-				auto tensor_data = static_cast<float*>(TF_TensorData(output_tensor));
-				//std::cout << tensor_data[0] << std::endl;
 
-				forwardSamples = 0;
+double MultiDetector::sumDrift(unsigned int windowRows)
+{
+	unsigned int temporalReadIndex = (roundBufferWriteIndex - windowRows) & roundBufferMask;
+	double sum = 0.;
+	for (unsigned int idx = 0; idx < windowRows; idx++) {
+		sum += roundBufferDrift[temporalReadIndex + idx];
+	}
+	return sum;
+}
 
-				// Event 0
-				if ((thresholdSign1 * tensor_data[0]) >= (thresholdSign1 * threshold1) && channel1 >= 0) {
-					forwardSamples = 1;
 
-					//std::cout << tsBuffer << " " << numSamples << " " << sample << " " << tensor_data[0] << std::endl;
-					sendTTLEvent1(tsBuffer, numSamples, sample, channel1);
-				}
+void MultiDetector::predictWindow(uint64 tsBuffer, int sample)
+{
+	//std::cout << "Sample: " << sample << " Downsample: " << sample/downsampleFactor << " Time: " << (unsigned int)(1000.f * float(tsBuffer + sample) / samplingRate) << std::endl;
+	sinceLast = 0;
+	nextSampleEnable = sample + 1;
 
-				// Event 2
-				if ((thresholdSign2 * tensor_data[2]) >= (thresholdSign2 * threshold2) && channel2 >= 0) {
-					forwardSamples = 1;
+	// If still calibrating do nothing yet
+	if (isCalibration == true) return;
 
-					//std::cout << tensor_data[2] << " " << tensor_data[7] << std::endl;
-					sendTTLEvent2(tsBuffer, numSamples, sample, channel2);
-				}
+	// If drift threshold is bigger than 0 then check the channels absolute mean. The sum over the window is
+	// kept as rows are saved, so windows with drift are skipped before anything is built
+	if (thrDrift > 0 && windowDriftSum / predictBufferSize >= thrDrift) {
+		publishProbability(sample, nullptr);
+		return;
+	}
 
-				if (forwardSamples == 1) {
-					nextSampleEnable += timeoutSamples - 1;
-					//std::cout <<  "event" << " nextSample " << nextSampleEnable << std::endl;
-					// If an event has been found, next value to read will be the first upcoming window after timeout
-					roundBufferReadIndex = (oldRoundBufferReadIndex + std::max(timeoutDownsampled, effectiveStride)) % MAX_ROUND_BUFFER_SIZE;
-				}
+	// Ripple-band prefilter: windows with little band power skip the model. In Sync mode one in
+	// PREFILTER_AUDIT_INTERVAL of them runs anyway, without events, to estimate the detections lost
+	bool audit = false;
+	if (prefilterFraction > 0) {
+		prefilterWindows++;
+		if (rippleEnvelope < prefilterFraction * rippleBaseline) {
+			prefilterGated++;
+			audit = !asyncInference && !batchInference && prefilterGated % PREFILTER_AUDIT_INTERVAL == 0;
+			if (!audit) {
+				publishProbability(sample, nullptr);
+				return;
+			}
+		}
+	}
+
+	// The newest rows are one span of the round buffer, thanks to its mirrored tail, and they are already
+	// normalized (or raw, if the backend folded the z-score). The window is that span, it is only copied when
+	// it has to outlive this call (async request or batch slot)
+	unsigned int temporalReadIndex = (roundBufferWriteIndex - predictBufferSize) & roundBufferMask;
+	const float* window = &roundBuffer[temporalReadIndex * numChannels];
+
+	if (predictBuffer != nullptr) {
+		std::copy(window, window + predictBufferSize * numChannels, predictBuffer);
+	}
+
+	//Predict
+	/*FILE * f = fopen("salida4.txt", "a");
+
+	for (int idx = 0; idx < predictBufferSize; idx++) {
+		fprintf(f, "%f ", window[(idx * numChannels) + 0]);
+	}
+	fprintf(f, "\n");
+	fclose(f);*/
+
+	if (asyncInference) {
+		// Results are handled by handleAsyncResults in a later buffer
+		asyncRequest.timestamp = tsBuffer + sample;
+		asyncRequest.drift = float(windowDriftSum / predictBufferSize);
+		if (requestQueue.push(asyncRequest)) inferenceThread->notify();
+		else droppedWindows++;
+		return;
+	}
+
+	if (batchInference) {
+		// The window stays in its slot and is run by flushBatch together with the next ones
+		batchSamples[batchSize] = sample;
+		batchDrift[batchSize] = float(windowDriftSum / predictBufferSize);
+		batchRows[batchSize] = rowsWritten;
+		batchSize++;
+		predictBuffer = batchWindows.data() + batchSize * predictBufferSize * numChannels;
+
+		if (batchSize == MAX_BATCH_SIZE) flushBatch(tsBuffer);
+		return;
+	}
 
-				tf_functions::delete_tensor(input_tensor);
-				tf_functions::delete_tensor(output_tensor);
+	const float* tensor_data;
+	auto start = std::chrono::steady_clock::now();
+	if (streamingActive && backend->inferStream(modelOutput.data())) {
+		// The stream ends at the newest row, as the window does. Until it holds a full window the whole window is run
+		tensor_data = modelOutput.data();
+	}
+	else {
+		tensor_data = runModel(window);
+	}
+	dueLatency += float(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+	// Check results
+	//std::cout << tensor_data[0] << std::endl;
+	publishProbability(sample, tensor_data);
+
+	if (audit) {
+		prefilterAudits++;
+		if ((thresholdSign1 * tensor_data[0]) >= (thresholdSign1 * threshold1)) prefilterMisses++;
+		return;
+	}
+
+	forwardSamples = 0;
+	bool checking = earlyPending;
+
+	// Event 0
+	if (scalesActive) {
+		// Sent by fuseDetections, with the votes of the other scales
+		mainProbability = tensor_data[0];
+		mainFresh = true;
+	}
+	else if (checking) {
+		// The pulse is out, the windows until the horizon only check it. The timeout starts from the pulse
+		checkEarlyTrigger(tsBuffer, sample, (thresholdSign1 * tensor_data[0]) >= (thresholdSign1 * threshold1));
+	}
+	else {
+		bool crossed = (thresholdSign1 * tensor_data[0]) >= (thresholdSign1 * threshold1);
+		bool early = earlyActive && predictCrossing(tsBuffer + sample, tensor_data[0]) && !crossed;
+
+		if ((crossed || early) && channel1 >= 0) {
+			forwardSamples = 1;
+
+			//std::cout << tsBuffer << " " << numSamples << " " << sample << " " << tensor_data[0] << std::endl;
+			detectionCount++;
+			sendTTLEvent(tsBuffer, sample, channel1);
+			journalDetection(tsBuffer + sample, channel1, tensor_data[0], float(windowDriftSum / predictBufferSize), dueLatency);
+
+			if (early) {
+				earlyTriggers++;
+				earlyPending = true;
+				earlyTimestamp = tsBuffer + sample;
+				earlyCheckUntil = earlyTimestamp + earlyHorizonSamples + earlyStrideSamples;
 			}
 		}
 	}
 
+	// Event 2
+	bool event2 = false;
+	if (outputSize > 2 && (thresholdSign2 * tensor_data[2]) >= (thresholdSign2 * threshold2) && channel2 >= 0) {
+		forwardSamples = 1;
+		event2 = true;
 
-	// Shift nextSampleEnable so it is relative to the next buffer
-	nextSampleEnable = juce::jmax(0, nextSampleEnable - numSamples);
+		//std::cout << tensor_data[2] << " " << tensor_data[7] << std::endl;
+		sendTTLEvent(tsBuffer, sample, channel2);
+		journalDetection(tsBuffer + sample, channel2, tensor_data[2], float(windowDriftSum / predictBufferSize), dueLatency);
+	}
+
+	if (event2 && (checking || earlyPending)) {
+		// Its timeout leaves no window to confirm an early pulse still being checked
+		if (earlyPending) {
+			earlyUnconfirmed++;
+			earlyPending = false;
+		}
+		nextSampleEnable = std::max(nextSampleEnable, sample + timeoutSamples);
+	}
+	else if (forwardSamples == 1 && !earlyPending) {
+		// If an event has been found, the next window ends after the timeout
+		nextSampleEnable += timeoutSamples - 1;
+		//std::cout <<  "event" << " nextSample " << nextSampleEnable << std::endl;
+	}
+}
+
+
+
+bool MultiDetector::predictCrossing(juce::int64 timestamp, float probability)
+{
+	// A skipped window or a timeout breaks the trend
+	if (earlyHistorySize > 0 && timestamp - earlyHistoryTs[earlyHistorySize - 1] > 2 * earlyStrideSamples) {
+		earlyHistorySize = 0;
+	}
+	if (earlyHistorySize == EARLY_TRIGGER_HISTORY) {
+		std::copy(earlyHistoryTs + 1, earlyHistoryTs + EARLY_TRIGGER_HISTORY, earlyHistoryTs);
+		std::copy(earlyHistory + 1, earlyHistory + EARLY_TRIGGER_HISTORY, earlyHistory);
+		earlyHistorySize--;
+	}
+	earlyHistoryTs[earlyHistorySize] = timestamp;
+	earlyHistory[earlyHistorySize] = probability;
+	earlyHistorySize++;
+
+	if (earlyHistorySize < EARLY_TRIGGER_HISTORY) return false;
+
+	// Least-squares slope per input sample, times relative to the newest window
+	double meanT = 0., meanP = 0.;
+	for (int idx = 0; idx < earlyHistorySize; idx++) {
+		meanT += double(earlyHistoryTs[idx] - timestamp);
+		meanP += earlyHistory[idx];
+	}
+	meanT /= earlyHistorySize;
+	meanP /= earlyHistorySize;
+
+	double covariance = 0., variance = 0.;
+	for (int idx = 0; idx < earlyHistorySize; idx++) {
+		double t = double(earlyHistoryTs[idx] - timestamp) - meanT;
+		covariance += t * (earlyHistory[idx] - meanP);
+		variance += t * t;
+	}
+	if (variance <= 0.) return false;
+
+	double slope = covariance / variance;
+	double projected = probability + slope * earlyHorizonSamples;
+	return thresholdSign1 * slope > 0 && thresholdSign1 * projected >= thresholdSign1 * threshold1;
+}
+
+
+void MultiDetector::checkEarlyTrigger(uint64 tsBuffer, int sample, bool crossed)
+{
+	juce::int64 timestamp = tsBuffer + sample;
+	bool confirmed = crossed && timestamp <= earlyCheckUntil;
+	if (!confirmed && timestamp < earlyCheckUntil) return;
+
+	if (confirmed) {
+		earlyConfirmed++;
+		earlyLeadSum += double(timestamp - earlyTimestamp);
+	}
+	else {
+		earlyUnconfirmed++;
+	}
+	earlyPending = false;
+
+	// The rest of the timeout of the early pulse
+	nextSampleEnable = std::max(nextSampleEnable, int(earlyTimestamp + timeoutSamples - juce::int64(tsBuffer)));
+}
+
+
+void MultiDetector::predictScales(int sample)
+{
+	for (int idx = 0; idx < scales.size(); idx++) {
+		DetectionScale* scale = scales[idx];
+		if (rowsNeeded(scale->windowRows, scale->stride, scale->sinceLast) > 0) continue;
+
+		scale->sinceLast = 0;
+		nextSampleEnable = std::max(nextSampleEnable, sample + 1);
+
+		if (isCalibration == true) continue;
+		if (thrDrift > 0 && scale->driftSum / scale->windowRows >= thrDrift) continue;
+		if (prefilterFraction > 0 && rippleEnvelope < prefilterFraction * rippleBaseline) continue;
+
+		// The newest rows of the round buffer, as for the main window
+		unsigned int temporalReadIndex = (roundBufferWriteIndex - scale->windowRows) & roundBufferMask;
+		auto start = std::chrono::steady_clock::now();
+		scale->backend->infer(&roundBuffer[temporalReadIndex * numChannels], 1, scale->output.data());
+		dueLatency += float(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		scale->probability = scale->output[0];
+		scale->fresh = true;
+	}
+}
+
+
+void MultiDetector::fuseDetections(uint64 tsBuffer, int sample)
+{
+	bool fresh = mainFresh;
+	for (int idx = 0; idx < scales.size(); idx++) {
+		fresh = fresh || scales[idx]->fresh;
+	}
+	if (!fresh) return;
+
+	// Probabilities are compared with the sign of the threshold, NAN (no window since the last event) never passes
+	float limit = thresholdSign1 * threshold1;
+	bool detected = false;
+
+	switch (fusionMode) {
+	case FUSION_AND:
+		// Every scale passes on its newest window
+		detected = thresholdSign1 * mainProbability >= limit;
+		for (int idx = 0; idx < scales.size(); idx++) {
+			detected = detected && thresholdSign1 * scales[idx]->probability >= limit;
+		}
+		break;
+
+	case FUSION_MAX:
+	{
+		// The highest of the newest probabilities, so a scale keeps voting until its next window
+		float best = thresholdSign1 * mainProbability;
+		for (int idx = 0; idx < scales.size(); idx++) {
+			float signedProbability = thresholdSign1 * scales[idx]->probability;
+			if (std::isnan(best) || signedProbability > best) best = signedProbability;
+		}
+		detected = best >= limit;
+		break;
+	}
+
+	default:
+		// Any window run now passes
+		detected = mainFresh && thresholdSign1 * mainProbability >= limit;
+		for (int idx = 0; idx < scales.size(); idx++) {
+			detected = detected || (scales[idx]->fresh && thresholdSign1 * scales[idx]->probability >= limit);
+		}
+		break;
+	}
+
+	mainFresh = false;
+	for (int idx = 0; idx < scales.size(); idx++) {
+		scales[idx]->fresh = false;
+	}
+
+	if (detected && channel1 >= 0) {
+		detectionCount++;
+		sendTTLEvent(tsBuffer, sample, channel1);
+
+		// The journal gets the strongest of the newest probabilities
+		float probability = mainProbability;
+		for (int idx = 0; idx < scales.size(); idx++) {
+			float scaleProbability = scales[idx]->probability;
+			if (std::isnan(probability) || thresholdSign1 * scaleProbability > thresholdSign1 * probability) probability = scaleProbability;
+		}
+		journalDetection(tsBuffer + sample, channel1, probability, float(windowDriftSum / predictBufferSize), dueLatency);
+
+		// Windows before the event do not vote for the next one, which comes after the timeout
+		mainProbability = NAN;
+		for (int idx = 0; idx < scales.size(); idx++) {
+			scales[idx]->probability = NAN;
+		}
+		nextSampleEnable = std::max(nextSampleEnable, sample + timeoutSamples);
+	}
+}
+
+
+
+void MultiDetector::updateSettings()
+{
+	// The traces go after the channels passed through, at the input rate
+	probabilityChannel = -1;
+	numProbabilityTraces = 0;
+	if (!probabilityOutput) return;
+
+	const DataChannel* inChan = getDataChannel(0);
+	float rate = (inChan != nullptr) ? inChan->getSampleRate() : CoreServices::getGlobalSampleRate();
+	probabilityChannel = dataChannelArray.size();
+	numProbabilityTraces = (outputSize > 2) ? 2 : 1;
+
+	for (int idx = 0; idx < numProbabilityTraces; idx++) {
+		int output = idx * 2;
+		DataChannel* chan = new DataChannel(DataChannel::AUX_CHANNEL, rate, this);
+		chan->setName("CNN" + String(output));
+		chan->setDescription("Output " + String(output) + " of the CNN, held from the end of each window until the next one");
+		chan->setIdentifier("cnnripple.probability");
+		chan->setBitVolts(PROBABILITY_BIT_VOLTS);
+		chan->setDataUnits("p");
+		dataChannelArray.add(chan);
+	}
+}
+
+
+void MultiDetector::publishProbability(int sample, const float* outputs)
+{
+	if (numProbabilityTraces == 0) return;
+
+	// Windows that skip the model (drift or prefilter) publish 0
+	ProbabilityUpdate update;
+	update.sample = sample;
+	update.values[0] = (outputs != nullptr) ? outputs[0] : 0.f;
+	update.values[1] = (outputs != nullptr && outputSize > 2) ? outputs[2] : 0.f;
+
+	// Async results and batches come after windows skipped later in the buffer, the rest come in order
+	std::size_t idx = probabilityUpdates.size();
+	probabilityUpdates.push_back(update);
+	for (; idx > 0 && probabilityUpdates[idx - 1].sample > sample; idx--) {
+		probabilityUpdates[idx] = probabilityUpdates[idx - 1];
+	}
+	probabilityUpdates[idx] = update;
 }
 
 
+void MultiDetector::writeProbabilityTraces(AudioSampleBuffer& buffer, int numSamples)
+{
+	if (buffer.getNumChannels() < probabilityChannel + numProbabilityTraces) {
+		probabilityUpdates.clear();
+		return;
+	}
+
+	for (int trace = 0; trace < numProbabilityTraces; trace++) {
+		float* out = buffer.getWritePointer(probabilityChannel + trace);
+		int start = 0;
+
+		for (std::size_t idx = 0; idx < probabilityUpdates.size(); idx++) {
+			int end = juce::jlimit(start, numSamples, probabilityUpdates[idx].sample);
+			std::fill(out + start, out + end, heldProbability[trace]);
+			heldProbability[trace] = probabilityUpdates[idx].values[trace];
+			start = end;
+		}
+		std::fill(out + start, out + numSamples, heldProbability[trace]);
+	}
+
+	probabilityUpdates.clear();
+}
+
+
+void MultiDetector::journalDetection(juce::int64 timestamp, int line, float probability, float drift, float latency)
+{
+	if (journal == nullptr) return;
+
+	JournalRecord record;
+	record.timestamp = timestamp;
+	record.line = line;
+	record.probability = probability;
+	record.drift = drift;
+	record.latency = latency;
+	journal->add(record);
+}
+
 
 void MultiDetector::createEventChannels() {
-	int num_of_ttl_channels = 8;
-	ttlEventChannel = new EventChannel(EventChannel::TTL, num_of_ttl_channels, sizeof(uint8), CoreServices::getGlobalSampleRate(), this);
+	ttlEventChannel = new EventChannel(EventChannel::TTL, NUM_TTL_LINES, sizeof(uint8), CoreServices::getGlobalSampleRate(), this);
 	ttlEventChannel->setIdentifier("TTL_deep.event");
 
 	// set array
@@ -341,60 +1254,73 @@ void MultiDetector::createEventChannels() {
 }
 
 
-void MultiDetector::sendTTLEvent1(uint64 bufferTs, int bufferNumSamples, int sample_index, int eventChannel) {
-	// Send on event
-	juce::uint8 ttlDataOn = 1 << eventChannel;
-	int sampleNumOn = std::max(sample_index, 0);
-	juce::int64 eventTsOn = bufferTs + sampleNumOn;
-	TTLEventPtr eventOn = TTLEvent::createTTLEvent(ttlEventChannel, eventTsOn, &ttlDataOn, sizeof(juce::uint8), eventChannel);
-	addEvent(ttlEventChannel, eventOn, sampleNumOn);
+void MultiDetector::sendTTLEvent(uint64 bufferTs, int sample_index, int line) {
+	if (line < 0 || line >= NUM_TTL_LINES) return;
 
-	// Send off event
-	juce::uint8 ttlDataOff = 0;
-	int sampleNumOff = sampleNumOn + pulseDurationSamples;
-	juce::int64 eventTsOff = bufferTs + sampleNumOff;
-	TTLEventPtr eventOff = TTLEvent::createTTLEvent(ttlEventChannel, eventTsOff, &ttlDataOff, sizeof(juce::uint8), eventChannel);
+	// Both edges or none, so a line is never left on
+	if (ttlScheduler.available() < 2) {
+		droppedPulses++;
+		return;
+	}
 
+	juce::int64 eventTsOn = bufferTs + std::max(sample_index, 0);
+	ttlScheduler.schedule(eventTsOn, line, true);
+	ttlScheduler.schedule(eventTsOn + pulseDurationSamples, line, false);
+}
 
-	//std::cout << eventTsOn << "  " << eventTsOff << std::endl;
 
-	// Check if turn off event occurs during the actual buffer
-	if (sampleNumOff <= bufferNumSamples) {
-		// If it does, simply add the turn off event
-		addEvent(ttlEventChannel, eventOff, sampleNumOff);
-	}
-	else {
-		// if not, saves it for the next buffer
-		turnoffEvent1 = eventOff;
-	}
-}
+void MultiDetector::sendPendingEvents(uint64 bufferTs, int bufferNumSamples) {
+	ttlScheduler.popDue(bufferTs + bufferNumSamples, [&](juce::int64 eventTs, int line, bool state) {
+		// Only the first on and the last off of overlapping pulses change the line
+		ttlPulses[line] += state ? 1 : -1;
+		if (ttlPulses[line] != (state ? 1 : 0)) return;
 
-void MultiDetector::sendTTLEvent2(uint64 bufferTs, int bufferNumSamples, int sample_index, int eventChannel) {
-	// Send on event
-	juce::uint8 ttlDataOn = 1 << eventChannel;
-	int sampleNumOn = std::max(sample_index, 0);
-	juce::int64 eventTsOn = bufferTs + sampleNumOn;
-	TTLEventPtr eventOn = TTLEvent::createTTLEvent(ttlEventChannel, eventTsOn, &ttlDataOn, sizeof(juce::uint8), eventChannel);
-	addEvent(ttlEventChannel, eventOn, sampleNumOn);
+		ttlWord = juce::uint8(state ? (ttlWord | (1 << line)) : (ttlWord & ~(1 << line)));
+		int sampleNum = juce::jmax(0, int(eventTs - juce::int64(bufferTs)));
+		juce::int64 timestamp = bufferTs + sampleNum;
 
-	// Send off event
-	juce::uint8 ttlDataOff = 0;
-	int sampleNumOff = sampleNumOn + pulseDurationSamples;
-	juce::int64 eventTsOff = bufferTs + sampleNumOff;
-	TTLEventPtr eventOff = TTLEvent::createTTLEvent(ttlEventChannel, eventTsOff, &ttlDataOff, sizeof(juce::uint8), eventChannel);
+		if (ttlEventsPooled && blockEventBuffer != nullptr) {
+			char* bytes = &ttlEventBytes[line * ttlEventSize];
+			std::memcpy(bytes + TTL_EVENT_TIMESTAMP_OFFSET, &timestamp, sizeof(timestamp));
+			bytes[EVENT_BASE_SIZE] = char(ttlWord);
+			blockEventBuffer->addEvent(bytes, int(ttlEventSize), sampleNum);
+			return;
+		}
 
+		TTLEventPtr event = TTLEvent::createTTLEvent(ttlEventChannel, timestamp, &ttlWord, sizeof(juce::uint8), line);
+		addEvent(ttlEventChannel, event, sampleNum);
+	});
+}
 
-	//std::cout << eventTsOn << "  " << eventTsOff << std::endl;
 
-	// Check if turn off event occurs during the actual buffer
-	if (sampleNumOff <= bufferNumSamples) {
-		// If it does, simply add the turn off event
-		addEvent(ttlEventChannel, eventOff, sampleNumOff);
+bool MultiDetector::prepareTtlEvents() {
+	// The same bytes GenericProcessor::addEvent() writes, serialized once per line so only the timestamp and state change
+	ttlEventSize = ttlEventChannel->getDataSize() + ttlEventChannel->getTotalEventMetaDataSize() + EVENT_BASE_SIZE;
+	if (ttlEventChannel->getDataSize() != sizeof(juce::uint8) || TTL_EVENT_TIMESTAMP_OFFSET + sizeof(juce::int64) > EVENT_BASE_SIZE) {
+		return false;
 	}
-	else {
-		// if not, saves it for the next buffer
-		turnoffEvent2 = eventOff;
+	ttlEventBytes.assign(NUM_TTL_LINES * ttlEventSize, 0);
+	std::vector<char> expected(ttlEventSize);
+
+	for (int line = 0; line < NUM_TTL_LINES; line++) {
+		char* bytes = &ttlEventBytes[line * ttlEventSize];
+		juce::uint8 state = 0;
+		TTLEventPtr event = TTLEvent::createTTLEvent(ttlEventChannel, 0, &state, sizeof(juce::uint8), line);
+		if (!event->serialize(bytes, ttlEventSize)) return false;
+
+		// A patched event must match one serialized with the same values
+		juce::int64 timestamp = 0x123456789abcLL + line;
+		juce::uint8 word = juce::uint8(0xa5 ^ line);
+		TTLEventPtr check = TTLEvent::createTTLEvent(ttlEventChannel, timestamp, &word, sizeof(juce::uint8), line);
+		if (!check->serialize(expected.data(), ttlEventSize)) return false;
+
+		std::vector<char> patched(bytes, bytes + ttlEventSize);
+		std::memcpy(patched.data() + TTL_EVENT_TIMESTAMP_OFFSET, &timestamp, sizeof(timestamp));
+		patched[EVENT_BASE_SIZE] = char(word);
+		if (patched != expected) return false;
 	}
+
+	return true;
 }
 
 
@@ -402,42 +1328,249 @@ void MultiDetector::sendTTLEvent2(uint64 bufferTs, int bufferNumSamples, int sam
 
 bool MultiDetector::setFile(String fullpath) {
 	modelPath = fullpath;
+	modelLoaded = false;
+
+	// Release the previous model before loading the new one
+	backend = nullptr;
+	backend = createBackend(predictBufferSize);
 
+	outputSize = 0;
+	if (backend == nullptr || !backend->load(modelPath.toStdString())) {
+		printf("Can't load model\n");
+		backend = nullptr;
+		return false;
+	}
+
+	if (backend->getInputChannels() != numChannels) {
+		printf("The model takes %d channels\n", backend->getInputChannels());
+		setNumChannels(backend->getInputChannels());
+	}
+
+#ifdef CNN_RIPPLE_TENSORFLOW
+	if (backendType == BACKEND_TENSORFLOW) {
+		// Keep the tuned options, so they are shown in the editor
+		const tf_functions::session_options& options = static_cast<TensorFlowBackend*>(backend.get())->getSessionOptions();
+		intraOpThreads = options.intra_op_threads;
+		interOpThreads = options.inter_op_threads;
+		perSessionThreads = options.use_per_session_threads;
+	}
+#endif
 
-	if (tf_functions::load_session(modelPath.toStdString().c_str(), &graph, &session) == 0) {
-		modelLoaded = true;
+	// The outputs set the probability traces of updateSettings(), which runs before enable() prepares the backend
+	// again. A window too short for the model is reported by enable()
+	if (backend->prepare(predictBufferSize, 1)) outputSize = backend->getOutputSize();
 
-		// serving_default_conv1d_input
-		// serving_default_input_1
-		TF_Operation* input_op = TF_GraphOperationByName(graph, ("serving_default_"+inputLayer).toStdString().c_str());
-		input = TF_Output{ input_op, 0 };
-		if (input.oper == nullptr) {
-			printf("Can't init input_op\n");
+	printf("Loaded model with the %s backend\n", backend->getName());
+	printf("%s\n", modelPath.toStdString().c_str());
+
+	modelLoaded = true;
+
+	// The scales running the main model, or the engine, change with it. A scale that fails is dropped, the main model still runs
+	loadScales();
+	return true;
+}
+
+
+bool MultiDetector::loadScales()
+{
+	for (int idx = 0; idx < scales.size(); idx++) {
+		DetectionScale* scale = scales[idx];
+		String scaleModelPath = scale->modelPath.isEmpty() ? modelPath : scale->modelPath;
+
+		scale->backend = nullptr;
+		scale->backend = createBackend(scale->windowRows);
+		if (scale->backend == nullptr || !scale->backend->load(scaleModelPath.toStdString())) {
+			printf("Can't load the model of scale %d, the extra scales are off\n", idx + 1);
+			scales.clear();
+			scalesText = "";
 			return false;
 		}
 
-		printf("init input_op\n");
-
-		TF_Operation* output_op = TF_GraphOperationByName(graph, "StatefulPartitionedCall");
-		output = TF_Output{ output_op, 0 };
-		if (output.oper == nullptr) {
-			printf("Can't init output_op\n");
+		if (scale->backend->getInputChannels() != numChannels) {
+			printf("The model of scale %d takes %d channels, the main model %d. The extra scales are off\n", idx + 1,
+				scale->backend->getInputChannels(), numChannels);
+			scales.clear();
+			scalesText = "";
 			return false;
 		}
+	}
+
+	return true;
+}
+
+
+bool MultiDetector::setScales(String newScales)
+{
+	scales.clear();
+	scalesText = "";
+
+	std::istringstream scalesStream(newScales.toStdString());
+	std::string item;
+	while (std::getline(scalesStream, item, ';')) {
+		if (item.find_first_not_of(" \t") == std::string::npos) continue;
+
+		std::istringstream itemStream(item);
+		std::string windowText, strideText, pathText;
+		std::getline(itemStream, windowText, ',');
+		std::getline(itemStream, strideText, ',');
+		std::getline(itemStream, pathText);
+
+		// Rounded to the nearest model row
+		DetectionScale* scale = new DetectionScale();
+		scale->windowRows = int(std::floor(std::atof(windowText.c_str()) * downsampledSamplingRate / 1000. + 0.5));
+		scale->stride = int(std::floor(std::atof(strideText.c_str()) * downsampledSamplingRate / 1000. + 0.5));
+		scales.add(scale);
+
+		std::size_t pathStart = pathText.find_first_not_of(" \t");
+		if (pathStart != std::string::npos) {
+			scale->modelPath = String(pathText.substr(pathStart, pathText.find_last_not_of(" \t") - pathStart + 1));
+		}
 
-		printf("init output_op\n");
+		if (scale->windowRows < 1 || scale->stride < 1) {
+			printf("Invalid scale \"%s\", expected window,stride[,model directory] in ms\n", item.c_str());
+			scales.clear();
+			return false;
+		}
 	}
-	else {
-		return false;
+
+	scalesText = newScales;
+
+	// Loaded with the main model otherwise
+	if (modelLoaded) return loadScales();
+	return true;
+}
+
+void MultiDetector::setProbabilityOutput(bool newProbabilityOutput) {
+	probabilityOutput = newProbabilityOutput;
+}
+
+bool MultiDetector::getProbabilityOutput() {
+	return probabilityOutput;
+}
+
+void MultiDetector::setEarlyTrigger(float newEarlyHorizon) {
+	earlyHorizon = newEarlyHorizon;
+}
+
+float MultiDetector::getEarlyTrigger() {
+	return earlyHorizon;
+}
+
+void MultiDetector::setJournal(bool newJournal) {
+	journalEnabled = newJournal;
+}
+
+bool MultiDetector::getJournal() {
+	return journalEnabled;
+}
+
+void MultiDetector::setPrefilter(float newPrefilterFraction) {
+	prefilterFraction = newPrefilterFraction;
+}
+
+float MultiDetector::getPrefilter() {
+	return prefilterFraction;
+}
+
+String MultiDetector::getScales() {
+	return scalesText;
+}
+
+void MultiDetector::setFusion(int newFusionMode) {
+	fusionMode = newFusionMode;
+}
+
+int MultiDetector::getFusion() {
+	return fusionMode;
+}
+
+
+bool MultiDetector::setBackend(int newBackendType) {
+	backendType = newBackendType;
+
+	// Reload the current model with the selected engine
+	if (modelPath.isNotEmpty()) return setFile(modelPath);
+
+	return true;
+}
+
+int MultiDetector::getBackend() {
+	return backendType;
+}
+
+void MultiDetector::setFilterLength(int newFilterTaps) {
+	filterTaps = newFilterTaps;
+}
+
+int MultiDetector::getFilterLength() {
+	return filterTaps;
+}
+
+void MultiDetector::setStreaming(bool newStreaming) {
+	streamingInference = newStreaming;
+}
+
+bool MultiDetector::getStreaming() {
+	return streamingInference;
+}
+
+void MultiDetector::setAsync(bool newAsync) {
+	asyncInference = newAsync;
+}
+
+bool MultiDetector::getAsync() {
+	return asyncInference;
+}
+
+void MultiDetector::setBatch(bool newBatch) {
+	batchInference = newBatch;
+}
+
+bool MultiDetector::getBatch() {
+	return batchInference;
+}
+
+void MultiDetector::setWarmUpRuns(int newWarmUpRuns) {
+	warmUpRuns = newWarmUpRuns;
+}
+
+int MultiDetector::getWarmUpRuns() {
+	return warmUpRuns;
+}
+
+bool MultiDetector::setSessionOptions(int newIntraOpThreads, int newInterOpThreads, bool newPerSessionThreads, bool autoTune) {
+	// Reloading would replace the backend that process() or the inference thread is running. The model stays loaded
+	if (acquiring) {
+		printf("The session options cannot change during acquisition.\n");
+		return true;
 	}
 
+	intraOpThreads = newIntraOpThreads;
+	interOpThreads = newInterOpThreads;
+	perSessionThreads = newPerSessionThreads;
+	autoTuneSession = autoTune;
 
-	printf("%s\n", modelPath.toStdString().c_str());
+	// The options only take effect when the session is created
+	if (backendType == BACKEND_TENSORFLOW && modelPath.isNotEmpty()) return setFile(modelPath);
 
-	modelLoaded = true;
 	return true;
 }
 
+int MultiDetector::getIntraOpThreads() {
+	return intraOpThreads;
+}
+
+int MultiDetector::getInterOpThreads() {
+	return interOpThreads;
+}
+
+bool MultiDetector::getPerSessionThreads() {
+	return perSessionThreads;
+}
+
+bool MultiDetector::getAutoTune() {
+	return autoTuneSession;
+}
 
 void MultiDetector::setPredictBufferSize(float newPredictBufferSize) {
 	predictBufferSize = int(std::floor(newPredictBufferSize * downsampledSamplingRate));
@@ -461,8 +1594,7 @@ void MultiDetector::setPulseDuration(int newPulseDuration) {
 void MultiDetector::setCalibrationTime(float newCalibrationTime) {
 	calibrationTime = newCalibrationTime;
 
-	for (int i = 0; i < NUM_CHANNELS; i++) {
-		calibrationBuffer[i] = std::vector<float>(calibrationTime * downsampledSamplingRate);
+	for (int i = 0; i < numChannels; i++) {
 		channelsMeans[i] = 0.;
 	}
 
@@ -3,14 +3,95 @@
 #define MULTIDETECTOR_H_DEFINED
 
 #include <ProcessorHeaders.h>
-#include "tf_functions.hpp"
-
-#define MAX_ROUND_BUFFER_SIZE 3000
-#define NUM_CHANNELS 8
+#include "InferenceBackend.h"
+#include "SpscQueue.h"
+#include "dsp_functions.hpp"
+#include "TtlScheduler.h"
+#include "DetectionJournal.h"
+
+#define ROUND_BUFFER_HEADROOM 64 // Rows of the round buffer beyond a window and the gap to the next one
+#define CACHE_LINE_SIZE 64
+#define ASYNC_QUEUE_SIZE 64
+#define MAX_BATCH_SIZE 16
+#define NUM_TTL_LINES 8
+#define TTL_PENDING_TRANSITIONS 1024 // On and off transitions waiting to be sent, over all lines
+#define TTL_EVENT_TIMESTAMP_OFFSET 8 // Where Event::serialize() writes the timestamp
+#define EVENT_BUFFER_RESERVE 65536 // Bytes reserved in the event buffer, so sending events does not grow it
+#define PROBABILITY_BIT_VOLTS 0.0001f // Probability per bit when the traces are recorded as 16-bit samples
+#define MAX_PROBABILITY_TRACES 2
+#define JOURNAL_CAPACITY 65536 // Detections kept in the journal file, 1.5 MB
+#define EARLY_TRIGGER_HISTORY 3 // Newest probabilities the trend of the early trigger is fitted to
 
 //namespace must be an unique name for your plugin
 namespace MultiDetectorSpace
 {
+	class MultiDetector;
+
+	/** Engines selectable in the editor, see InferenceBackend */
+	enum BackendType
+	{
+		BACKEND_TENSORFLOW = 1,
+		BACKEND_NATIVE,
+		BACKEND_NATIVE_INT8,
+		BACKEND_REFERENCE
+	};
+
+	/** How the detections of the extra scales and the main window are combined into the TTL output */
+	enum FusionMode
+	{
+		FUSION_OR = 1,
+		FUSION_AND,
+		FUSION_MAX
+	};
+
+	/** Window length, stride and model run next to the main window, on the same round buffer and calibration */
+	struct DetectionScale
+	{
+		int windowRows;
+		int stride;
+		String modelPath; // Empty for the main model
+		ScopedPointer<InferenceBackend> backend;
+		std::vector<float> output;
+		unsigned int sinceLast;
+		double driftSum; // As windowDriftSum, over the rows of this window
+		float probability; // Output 0 of the newest window since the last event, NAN if none
+		bool fresh; // Run at the current due point
+	};
+
+	/** Runs the model on the windows queued by MultiDetector::process when inference is asynchronous */
+	class InferenceThread : public Thread
+	{
+	public:
+		InferenceThread(MultiDetector* detector);
+		void run() override;
+
+	private:
+		MultiDetector* detector;
+	};
+
+	/** Window queued for inference, stamped with the timestamp of the sample that triggered it */
+	struct InferenceRequest
+	{
+		juce::int64 timestamp;
+		float drift; // Of the window, for the journal
+		std::vector<float> window;
+	};
+
+	struct InferenceResult
+	{
+		juce::int64 timestamp;
+		float drift;
+		float latency; // Run time of the model in microseconds
+		std::vector<float> outputs;
+	};
+
+	/** Model outputs published at a sample of the current buffer, held until the next update */
+	struct ProbabilityUpdate
+	{
+		int sample;
+		float values[MAX_PROBABILITY_TRACES];
+	};
+
 	class MultiDetector : public GenericProcessor
 	{
 	public:
@@ -41,6 +122,9 @@ namespace MultiDetectorSpace
 		*/
 		void process(AudioSampleBuffer& buffer) override;
 
+		/** Keeps the event buffer of the block, the TTL events are written to it directly */
+		void processBlock(AudioSampleBuffer& buffer, MidiBuffer& eventBuffer) override;
+
 		/** Handles events received by the processor
 
 		Called automatically for each received event whenever checkForEvents() is called from process()		
@@ -72,13 +156,58 @@ namespace MultiDetectorSpace
 		structure shouldn't be manipulated outside of this method.
 
 		*/
-		//void updateSettings() override;
+		void updateSettings() override;
 
 
 		bool enable() override;
 		bool disable() override;
 
 		bool setFile(String fullpath);
+		bool setBackend(int newBackendType);
+		int getBackend();
+		void setFilterLength(int newFilterTaps);
+		int getFilterLength();
+		void setStreaming(bool newStreaming);
+		bool getStreaming();
+		void setAsync(bool newAsync);
+		bool getAsync();
+		void setBatch(bool newBatch);
+		bool getBatch();
+
+		/** Extra scales as "window,stride[,model directory]" in ms, separated by ';'. Without a directory a scale
+		runs the main model. Returns false if a scale is malformed or its model cannot be loaded */
+		bool setScales(String newScales);
+		String getScales();
+		void setFusion(int newFusionMode);
+		int getFusion();
+
+		/** Ripple-band prefilter: the model only runs when the 100-250 Hz power envelope is above this fraction
+		of its calibration mean. 0 turns it off */
+		void setPrefilter(float newPrefilterFraction);
+		float getPrefilter();
+
+		/** Adds the model outputs (0, and 2 if the model has it) as continuous channels after the inputs, held at
+		the input rate from the end of each window. The signal chain has to be updated for it to take effect */
+		void setProbabilityOutput(bool newProbabilityOutput);
+		bool getProbabilityOutput();
+
+		/** Early trigger: in Sync mode, also detects when the trend of the newest probabilities crosses the threshold
+		within this many ms. 0 turns it off */
+		void setEarlyTrigger(float newEarlyHorizon);
+		float getEarlyTrigger();
+
+		/** Writes every detection to a journal file in the default save directory, one per acquisition */
+		void setJournal(bool newJournal);
+		bool getJournal();
+
+		void setWarmUpRuns(int newWarmUpRuns);
+		int getWarmUpRuns();
+
+		bool setSessionOptions(int newIntraOpThreads, int newInterOpThreads, bool newPerSessionThreads, bool autoTune);
+		int getIntraOpThreads();
+		int getInterOpThreads();
+		bool getPerSessionThreads();
+		bool getAutoTune();
 
 		float getPredictBufferSize();
 		void setPredictBufferSize(float newPredictBufferSize);
@@ -104,6 +233,24 @@ namespace MultiDetectorSpace
 		void setThrDrift(float newThrDrift);
 
 	private:
+		friend class InferenceThread;
+
+		InferenceBackend* createBackend(int windowSteps);
+		bool loadScales();
+		void setNumChannels(int newNumChannels);
+		void updateInputNormalization();
+		void writeRows(const float* rows, std::size_t numRows);
+		void writeRoundBuffer(const float* rows, std::size_t numRows, bool calibrated);
+		void normalizeRoundBuffer();
+		void predictWindow(uint64 bufferTs, int sample);
+		void predictScales(int sample);
+		void fuseDetections(uint64 bufferTs, int sample);
+		int rowsNeeded(unsigned int windowRows, int stride, unsigned int rowsSinceLast);
+		double sumDrift(unsigned int windowRows);
+		const float* runModel(const float* window);
+		void handleAsyncResults(uint64 bufferTs, int bufferNumSamples);
+		const float* runModelBatch(int numWindows);
+		void flushBatch(uint64 bufferTs);
 
 		float calculateMean(std::vector<float> data);
 		float calculateStd(std::vector<float> data, float mean);
@@ -112,36 +259,54 @@ namespace MultiDetectorSpace
 		double getStd(int chan);
 
 		void createEventChannels();
-		void sendTTLEvent1(uint64 bufferTs, int bufferNumSamples, int sample_index, int eventChannel);
-		void sendTTLEvent2(uint64 bufferTs, int bufferNumSamples, int sample_index, int eventChannel);
+		void sendTTLEvent(uint64 bufferTs, int sample_index, int line);
+		void sendPendingEvents(uint64 bufferTs, int bufferNumSamples);
+		bool prepareTtlEvents();
+		void publishProbability(int sample, const float* outputs);
+		void writeProbabilityTraces(AudioSampleBuffer& buffer, int numSamples);
+		void journalDetection(juce::int64 timestamp, int line, float probability, float drift, float latency);
+		bool predictCrossing(juce::int64 timestamp, float probability);
+		void checkEarlyTrigger(uint64 tsBuffer, int sample, bool crossed);
 
 		EventChannel *ttlEventChannel;
 
 		String modelPath;
 		bool modelLoaded;
+		bool acquiring; // From enable() to disable(), while the backend is in use
 
 		bool isCalibration;
 		float calibrationTime;
 		int elapsedCalibration;
 		std::vector<double> channelsOldStds, channelsNewStds, channelsStds;
 		std::vector<double> channelsOldMeans, channelsNewMeans, channelsMeans;
-		std::vector<std::vector<float>> calibrationBuffer;
 
-		float roundBuffer[MAX_ROUND_BUFFER_SIZE][NUM_CHANNELS];
+		int numChannels; // Model input channels, taken from the first channels of the buffer
+		std::vector<const float*> channelsData; // Read pointers of the buffer being processed
+		std::vector<float> normMeans, normInvStds; // z-score of each channel, as used by the window kernels
+
+		std::vector<float> roundBufferStorage; // Memory of roundBuffer, with room to align it
+		float* roundBuffer; // [roundBufferSize + predictBufferSize][numChannels] from a cache line, the last rows mirror the first ones.
+		                    // Rows are z-scored when saved, unless the backend takes raw samples
+		unsigned int roundBufferSize; // Rows, a power of two sized by enable()
+		unsigned int maxWindowRows; // Longest window of any scale, the rows mirrored after the end
+		unsigned int roundBufferMask;
+		std::vector<float> roundBufferDrift; // Absolute mean of each normalized row, mirrored in the same way
+		double windowDriftSum; // Sum of roundBufferDrift over the newest predictBufferSize rows
 		unsigned int roundBufferWriteIndex;
-		unsigned int roundBufferReadIndex;
 		unsigned int roundBufferNumElements;
 
-		std::vector<float> predictBuffer;
-		std::vector<float> predictBufferSum;
+		float * predictBuffer; // Points to the memory the next window is copied to (request or batch slot), nullptr if it is run in place
 		unsigned int predictBufferSize;
 		int effectiveStride;
 		float thrDrift;
-		bool skipPrediction;
 
 		float samplingRate;
 		float downsampledSamplingRate;
-		unsigned int downsampleFactor;
+		float downsampleFactor; // Input samples per model sample, may be fractional
+		int filterTaps; // Anti-aliasing filter length in taps per model sample, 0 takes the input samples unfiltered
+		dsp_functions::resampler inputResampler;
+		std::vector<float> decimatedRows; // [rows][numChannels] resampled from the buffer being processed
+		std::vector<std::size_t> decimatedSamples; // Buffer sample each row ends at
 		unsigned int loopIndex;
 		unsigned int sinceLast;
 
@@ -153,7 +318,6 @@ namespace MultiDetectorSpace
 		String inputLayer;
 
 		int nextSampleEnable;
-		int globalSample;
 		unsigned int forwardSamples;
 
 		float threshold1;
@@ -164,12 +328,102 @@ namespace MultiDetectorSpace
 		int channel1;
 		int channel2;
 
-		TTLEventPtr turnoffEvent1; // Variable to store a turn off event that should go in the next buffer
-		TTLEventPtr turnoffEvent2;
-
-		TF_Graph * graph = nullptr;
-		TF_Session * session = nullptr;
-		TF_Output input, output;
+		TtlScheduler ttlScheduler; // Pulse edges of every line, sent by the buffer they fall in
+		juce::uint8 ttlWord; // State of the lines after the last event sent
+		int ttlPulses[NUM_TTL_LINES]; // Pulses in progress on each line, overlapping ones merge into one
+		unsigned int droppedPulses;
+		MidiBuffer* blockEventBuffer; // Event buffer of the block being processed
+		std::vector<char> ttlEventBytes; // [NUM_TTL_LINES][ttlEventSize] serialized event of each line, patched with timestamp and state
+		size_t ttlEventSize;
+		bool ttlEventsPooled; // The patched events matched Event::serialize(), otherwise each one is created
+
+		int backendType;
+		ScopedPointer<InferenceBackend> backend;
+		std::vector<float> modelOutput;
+		int outputSize; // Model outputs per window
+		bool rawInput; // The backend folded the z-score into the model and takes raw samples
+
+		// TensorFlow session options
+		int intraOpThreads;
+		int interOpThreads;
+		bool perSessionThreads;
+		bool autoTuneSession; // Benchmark the threading options when the session is loaded
+		int warmUpRuns; // Dummy passes run by enable() so lazy initialization does not delay the first detection
+
+		bool streamingInference; // Reuse the activations of overlapping windows, if the backend can
+		bool streamingActive;
+
+		// Asynchronous inference: windows go to inferenceThread and results come back to process()
+		bool asyncInference;
+		ScopedPointer<InferenceThread> inferenceThread;
+		SpscQueue<InferenceRequest> requestQueue;
+		SpscQueue<InferenceResult> resultQueue;
+		InferenceRequest asyncRequest;  // Window being built by process()
+		InferenceRequest workerRequest; // Owned by the inference thread
+		InferenceResult workerResult;
+		InferenceResult asyncResult;    // Owned by process()
+		juce::int64 asyncNextTimestamp; // Results before this timestamp fall in the timeout of a previous event
+		unsigned int droppedWindows;
+
+		// Batched inference: the windows of a buffer are collected and run together, before the rows reach the
+		// timeout of the first one
+		bool batchInference;
+		std::vector<float> batchWindows; // [MAX_BATCH_SIZE][predictBufferSize][numChannels]
+		std::vector<float> batchOutputs; // [MAX_BATCH_SIZE][outputSize]
+		int batchSamples[MAX_BATCH_SIZE]; // Buffer sample that triggered each window
+		float batchDrift[MAX_BATCH_SIZE];
+		juce::uint64 batchRows[MAX_BATCH_SIZE]; // rowsWritten when each window was collected
+		int batchSize;
+		juce::uint64 rowsWritten; // Rows saved since enable()
+
+		// Multi-scale detection: extra windows run in Sync mode, on their own stride, and vote with the main one
+		OwnedArray<DetectionScale> scales;
+		String scalesText;
+		int fusionMode;
+		bool scalesActive;
+		float mainProbability; // Output 0 of the newest main window since the last event, NAN if none
+		bool mainFresh;
+
+		// Ripple-band prefilter in front of the model
+		float prefilterFraction;
+		dsp_functions::band_filter rippleFilter;
+		std::vector<float> ripplePower; // Band power of each row being written
+		double rippleEnvelope; // Band power smoothed over PREFILTER_TIME_CONSTANT
+		double rippleBaseline; // Mean band power during calibration
+		double prefilterAlpha; // Envelope smoothing per row
+		unsigned int prefilterWindows; // Windows checked by the prefilter in this acquisition
+		unsigned int prefilterGated;
+		unsigned int prefilterAudits;
+		unsigned int prefilterMisses; // Audited windows that would have detected
+		unsigned int detectionCount;
+
+		// Probability traces published as continuous channels
+		bool probabilityOutput;
+		int probabilityChannel; // Buffer channel of the first trace, -1 without traces
+		int numProbabilityTraces;
+		float heldProbability[MAX_PROBABILITY_TRACES]; // Value of each trace at the end of the last buffer
+		std::vector<ProbabilityUpdate> probabilityUpdates; // Of the current buffer, sorted by sample
+
+		// Detection journal
+		bool journalEnabled;
+		ScopedPointer<DetectionJournal> journal; // Open during acquisition
+		float dueLatency; // Run time of the models at the current due point, in microseconds
+
+		// Early trigger from the trend of the main window probability
+		float earlyHorizon; // ms
+		bool earlyActive;
+		juce::int64 earlyHorizonSamples;
+		juce::int64 earlyStrideSamples; // Input samples between consecutive windows
+		juce::int64 earlyHistoryTs[EARLY_TRIGGER_HISTORY]; // Newest last
+		float earlyHistory[EARLY_TRIGGER_HISTORY];
+		int earlyHistorySize;
+		bool earlyPending; // An early pulse was sent, the next windows check whether the threshold is crossed
+		juce::int64 earlyTimestamp;
+		juce::int64 earlyCheckUntil;
+		unsigned int earlyTriggers;
+		unsigned int earlyConfirmed;
+		unsigned int earlyUnconfirmed; // Not followed by a crossing, the false positives the early trigger may add
+		double earlyLeadSum; // Samples the confirmed early pulses went out before the crossing
 
 
 
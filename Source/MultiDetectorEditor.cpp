@@ -11,7 +11,7 @@ MultiDetectorEditor::MultiDetectorEditor(GenericProcessor* parentNode, bool useD
     supportedFileExtensions = "*.pb"; 
 
     int fontSize = 15;
-    desiredWidth = 450;
+    desiredWidth = 1125;
 
 
 	/* ------------- Top row (File selector) ------------- */
@@ -26,6 +26,69 @@ MultiDetectorEditor::MultiDetectorEditor(GenericProcessor* parentNode, bool useD
     fileNameLabel = createLabel("FileNameLabel", "No file selected.", {xPos + 20, yPos, 140, fontSize});
     addAndMakeVisible(fileNameLabel);
 
+    warmUpLabel = createLabel("warmUpLabel", "Warm-up:", { xPos + 165, yPos, 60, fontSize });
+    addAndMakeVisible(warmUpLabel);
+
+    warmUpText = createTextField("warmUpText", String(rippleDetector->getWarmUpRuns()), "Dummy inferences run before acquisition starts", { xPos + 165 + 60, yPos, 35, fontSize });
+    addAndMakeVisible(warmUpText);
+
+    engineLabel = createLabel("engineLabel", "Engine:", { xPos + 270, yPos, 60, fontSize });
+    addAndMakeVisible(engineLabel);
+
+    engineSelector = new ComboBox("Inference engine");
+    engineSelector->addItem("TensorFlow", MultiDetectorSpace::BACKEND_TENSORFLOW);
+    engineSelector->addItem("Native", MultiDetectorSpace::BACKEND_NATIVE);
+    engineSelector->addItem("Native INT8", MultiDetectorSpace::BACKEND_NATIVE_INT8);
+    engineSelector->addItem("Reference", MultiDetectorSpace::BACKEND_REFERENCE);
+    engineSelector->setSelectedId(rippleDetector->getBackend(), dontSendNotification);
+    engineSelector->setTooltip("Engine used to run the CNN");
+    engineSelector->setBounds(xPos + 315 + 10, yPos, 90, fontSize);
+    engineSelector->addListener(this);
+    addAndMakeVisible(engineSelector);
+
+    modeLabel = createLabel("modeLabel", "Mode:", { xPos + 450, yPos, 60, fontSize });
+    addAndMakeVisible(modeLabel);
+
+    modeSelector = new ComboBox("Inference mode");
+    modeSelector->addItem("Sync", 1);
+    modeSelector->addItem("Async", 2);
+    modeSelector->addItem("Batch", 3);
+    modeSelector->setSelectedId(rippleDetector->getAsync() ? 2 : (rippleDetector->getBatch() ? 3 : 1), dontSendNotification);
+    modeSelector->setTooltip("Sync runs every window as it comes, Async on a separate thread, Batch the windows of a buffer together");
+    modeSelector->setBounds(xPos + 450 + 45, yPos, 75, fontSize);
+    modeSelector->addListener(this);
+    addAndMakeVisible(modeSelector);
+
+    autoTuneLabel = createLabel("autoTuneLabel", "Tune:", { xPos + 585, yPos, 60, fontSize });
+    addAndMakeVisible(autoTuneLabel);
+
+    autoTuneSelector = new ComboBox("Session auto-tune");
+    autoTuneSelector->addItem("Off", 1);
+    autoTuneSelector->addItem("On", 2);
+    autoTuneSelector->setSelectedId(rippleDetector->getAutoTune() ? 2 : 1, dontSendNotification);
+    autoTuneSelector->setTooltip("Benchmark TensorFlow threading options when the model is loaded and keep the fastest");
+    autoTuneSelector->setBounds(xPos + 585 + 50, yPos, 50, fontSize);
+    autoTuneSelector->addListener(this);
+    addAndMakeVisible(autoTuneSelector);
+
+    scalesLabel = createLabel("scalesLabel", "Scales:", { xPos + 720, yPos, 60, fontSize });
+    addAndMakeVisible(scalesLabel);
+
+    scalesText = createTextField("scalesText", rippleDetector->getScales(), "Extra windows run with the main one, as window,stride[,model directory] in ms separated by ';' (e.g. 25.6,12.8)", { xPos + 720 + 45, yPos, 70, fontSize });
+    addAndMakeVisible(scalesText);
+
+    journalLabel = createLabel("journalLabel", "Journal:", { xPos + 855, yPos, 60, fontSize });
+    addAndMakeVisible(journalLabel);
+
+    journalSelector = new ComboBox("Detection journal");
+    journalSelector->addItem("Off", 1);
+    journalSelector->addItem("On", 2);
+    journalSelector->setSelectedId(rippleDetector->getJournal() ? 2 : 1, dontSendNotification);
+    journalSelector->setTooltip("Write every detection to a journal file in the default save directory");
+    journalSelector->setBounds(xPos + 855 + 50, yPos, 50, fontSize);
+    journalSelector->addListener(this);
+    addAndMakeVisible(journalSelector);
+
     /*
     windowSizeLabel = createLabel("windowSizeLabel", "Window size (s):", {xPos + 325, yPos, 140, fontSize});
     addAndMakeVisible(windowSizeLabel);
@@ -62,6 +125,48 @@ MultiDetectorEditor::MultiDetectorEditor(GenericProcessor* parentNode, bool useD
     thrDriftText = createTextField("thrDriftText", String(rippleDetector->getThrDrift()), "Drift prevention threshold (standard deviations)", { xPos + 315 + 10, yPos + 20, 50, fontSize });
     addAndMakeVisible(thrDriftText);
 
+    strideLabel = createLabel("strideLabel", "Stride (s):", { xPos + 450, yPos, 140, fontSize });
+    addAndMakeVisible(strideLabel);
+
+    strideText = createTextField("strideText", String(rippleDetector->getStride()), "Time between predictions in seconds", { xPos + 450 + 10, yPos + 20, 50, fontSize });
+    addAndMakeVisible(strideText);
+
+    threadsLabel = createLabel("threadsLabel", "Intra/inter threads:", { xPos + 585, yPos, 140, fontSize });
+    addAndMakeVisible(threadsLabel);
+
+    intraOpThreadsText = createTextField("intraOpThreadsText", String(rippleDetector->getIntraOpThreads()), "TensorFlow threads used inside an op", { xPos + 585 + 10, yPos + 20, 40, fontSize });
+    addAndMakeVisible(intraOpThreadsText);
+
+    interOpThreadsText = createTextField("interOpThreadsText", String(rippleDetector->getInterOpThreads()), "TensorFlow ops run in parallel", { xPos + 585 + 60, yPos + 20, 40, fontSize });
+    addAndMakeVisible(interOpThreadsText);
+
+    filterLabel = createLabel("filterLabel", "Input filter:", { xPos + 720, yPos, 140, fontSize });
+    addAndMakeVisible(filterLabel);
+
+    // Item ids are the taps per 1250 Hz sample plus one
+    filterSelector = new ComboBox("Input filter");
+    filterSelector->addItem("Off", 1);
+    filterSelector->addItem("4 taps", 5);
+    filterSelector->addItem("8 taps", 9);
+    filterSelector->addItem("16 taps", 17);
+    filterSelector->setSelectedId(rippleDetector->getFilterLength() + 1, dontSendNotification);
+    filterSelector->setTooltip("Anti-aliasing filter length per 1250 Hz sample. Longer filters reject more and delay detections more");
+    filterSelector->setBounds(xPos + 720 + 10, yPos + 20, 70, fontSize);
+    filterSelector->addListener(this);
+    addAndMakeVisible(filterSelector);
+
+    prefilterLabel = createLabel("prefilterLabel", "Ripple gate:", { xPos + 855, yPos, 140, fontSize });
+    addAndMakeVisible(prefilterLabel);
+
+    prefilterText = createTextField("prefilterText", String(rippleDetector->getPrefilter()), "Run the CNN only when the 100-250 Hz power is above this fraction of its calibration mean (0 is off)", { xPos + 855 + 10, yPos + 20, 50, fontSize });
+    addAndMakeVisible(prefilterText);
+
+    earlyLabel = createLabel("earlyLabel", "Early (ms):", { xPos + 990, yPos, 140, fontSize });
+    addAndMakeVisible(earlyLabel);
+
+    earlyText = createTextField("earlyText", String(rippleDetector->getEarlyTrigger()), "Also detect when the trend of the newest probabilities crosses the threshold within this time (0 is off, Sync mode)", { xPos + 990 + 10, yPos + 20, 50, fontSize });
+    addAndMakeVisible(earlyText);
+
 
 
     /*inputLayerText = createTextField("inputLayerText", rippleDetector->getInputLayer(), "inputLayer", { xPos + 400, yPos + 20, 200, fontSize });
@@ -102,6 +207,55 @@ MultiDetectorEditor::MultiDetectorEditor(GenericProcessor* parentNode, bool useD
     outSelector1->addListener(this);
     addAndMakeVisible(outSelector1);
 
+    streamingLabel = createLabel("streamingLabel", "Streaming:", { xPos + 450, yPos, 140, fontSize });
+    addAndMakeVisible(streamingLabel);
+
+    streamingSelector = new ComboBox("Streaming inference");
+    streamingSelector->addItem("Off", 1);
+    streamingSelector->addItem("On", 2);
+    streamingSelector->setSelectedId(rippleDetector->getStreaming() ? 2 : 1, dontSendNotification);
+    streamingSelector->setTooltip("Reuse the activations of overlapping windows (native engine)");
+    streamingSelector->setBounds(xPos + 450 + 10, yPos + 20, 50, fontSize);
+    streamingSelector->addListener(this);
+    addAndMakeVisible(streamingSelector);
+
+    perSessionThreadsLabel = createLabel("perSessionThreadsLabel", "Session threads:", { xPos + 585, yPos, 140, fontSize });
+    addAndMakeVisible(perSessionThreadsLabel);
+
+    perSessionThreadsSelector = new ComboBox("Per session threads");
+    perSessionThreadsSelector->addItem("Shared", 1);
+    perSessionThreadsSelector->addItem("Own", 2);
+    perSessionThreadsSelector->setSelectedId(rippleDetector->getPerSessionThreads() ? 2 : 1, dontSendNotification);
+    perSessionThreadsSelector->setTooltip("Use the process-wide TensorFlow thread pools or pools owned by this session");
+    perSessionThreadsSelector->setBounds(xPos + 585 + 10, yPos + 20, 70, fontSize);
+    perSessionThreadsSelector->addListener(this);
+    addAndMakeVisible(perSessionThreadsSelector);
+
+    fusionLabel = createLabel("fusionLabel", "Fusion:", { xPos + 720, yPos, 140, fontSize });
+    addAndMakeVisible(fusionLabel);
+
+    fusionSelector = new ComboBox("Scale fusion");
+    fusionSelector->addItem("OR", MultiDetectorSpace::FUSION_OR);
+    fusionSelector->addItem("AND", MultiDetectorSpace::FUSION_AND);
+    fusionSelector->addItem("Max", MultiDetectorSpace::FUSION_MAX);
+    fusionSelector->setSelectedId(rippleDetector->getFusion(), dontSendNotification);
+    fusionSelector->setTooltip("OR detects when any window run passes the threshold, AND when the newest windows of every scale pass it, Max when the highest newest probability does");
+    fusionSelector->setBounds(xPos + 720 + 10, yPos + 20, 60, fontSize);
+    fusionSelector->addListener(this);
+    addAndMakeVisible(fusionSelector);
+
+    probabilityLabel = createLabel("probabilityLabel", "Prob. out:", { xPos + 855, yPos, 140, fontSize });
+    addAndMakeVisible(probabilityLabel);
+
+    probabilitySelector = new ComboBox("Probability output");
+    probabilitySelector->addItem("Off", 1);
+    probabilitySelector->addItem("On", 2);
+    probabilitySelector->setSelectedId(rippleDetector->getProbabilityOutput() ? 2 : 1, dontSendNotification);
+    probabilitySelector->setTooltip("Add the CNN probability as continuous channels after the inputs");
+    probabilitySelector->setBounds(xPos + 855 + 10, yPos + 20, 50, fontSize);
+    probabilitySelector->addListener(this);
+    addAndMakeVisible(probabilitySelector);
+
     /*outLabel2 = createLabel("outLabel2", "Out 2:", { xPos + 500, yPos, 140, fontSize });
     addAndMakeVisible(outLabel2);
 
@@ -120,6 +274,43 @@ MultiDetectorEditor::~MultiDetectorEditor()
 }
 
 
+void MultiDetectorEditor::startAcquisition()
+{
+    GenericEditor::startAcquisition();
+
+    // Loading a model replaces the backend that process() is running
+    engineSelector->setEnabled(false);
+    fileButton->setEnabled(false);
+    // The inference thread and the batch buffers are set up in enable()
+    modeSelector->setEnabled(false);
+    // Each scale loads its own model
+    scalesText->setEnabled(false);
+    // The session options reload the model, and tuning runs every candidate session
+    intraOpThreadsText->setEnabled(false);
+    interOpThreadsText->setEnabled(false);
+    perSessionThreadsSelector->setEnabled(false);
+    autoTuneSelector->setEnabled(false);
+    // The trace channels are rebuilt by the signal chain update, process() writes the ones of enable()
+    probabilitySelector->setEnabled(false);
+}
+
+
+void MultiDetectorEditor::stopAcquisition()
+{
+    GenericEditor::stopAcquisition();
+
+    engineSelector->setEnabled(true);
+    fileButton->setEnabled(true);
+    modeSelector->setEnabled(true);
+    scalesText->setEnabled(true);
+    intraOpThreadsText->setEnabled(true);
+    interOpThreadsText->setEnabled(true);
+    perSessionThreadsSelector->setEnabled(true);
+    autoTuneSelector->setEnabled(true);
+    probabilitySelector->setEnabled(true);
+}
+
+
 Label * MultiDetectorEditor::createTextField (const String& name, const String& initialValue, const String& tooltip, juce::Rectangle<int> bounds)
 {
     Label* textField = new Label(name, initialValue);
@@ -176,6 +367,11 @@ void MultiDetectorEditor::setFile (String file)
     if (rippleDetector->setFile(filePath)) {
         fileNameLabel->setText(fileFullName, dontSendNotification);
 
+        // Auto-tuning may have changed the session threads
+        intraOpThreadsText->setText(String(rippleDetector->getIntraOpThreads()), dontSendNotification);
+        interOpThreadsText->setText(String(rippleDetector->getInterOpThreads()), dontSendNotification);
+        perSessionThreadsSelector->setSelectedId(rippleDetector->getPerSessionThreads() ? 2 : 1, dontSendNotification);
+
         setEnabledState(true);
     }
     else {
@@ -241,9 +437,39 @@ void MultiDetectorEditor::labelTextChanged(Label * labelThatHasChanged)
     } else if (labelThatHasChanged == strideText) {
         float newStride;
 
-        if (updateFloatLabel(labelThatHasChanged, -50., 50., rippleDetector->getStride(), &newStride)) {
+        // At least one sample of the 1250 Hz stream
+        if (updateFloatLabel(labelThatHasChanged, 0.0008, 1., rippleDetector->getStride(), &newStride)) {
             rippleDetector->setStride(newStride);
         }
+    } else if (labelThatHasChanged == intraOpThreadsText || labelThatHasChanged == interOpThreadsText) {
+        int newThreads;
+        int defaultThreads = (labelThatHasChanged == intraOpThreadsText) ? rippleDetector->getIntraOpThreads() : rippleDetector->getInterOpThreads();
+
+        if (updateIntLabel(labelThatHasChanged, 1, 64, defaultThreads, &newThreads)) {
+            updateSessionOptions();
+        }
+    } else if (labelThatHasChanged == warmUpText) {
+        int newWarmUpRuns;
+
+        if (updateIntLabel(labelThatHasChanged, 0, 1000, rippleDetector->getWarmUpRuns(), &newWarmUpRuns)) {
+            rippleDetector->setWarmUpRuns(newWarmUpRuns);
+        }
+    } else if (labelThatHasChanged == scalesText) {
+        // A malformed scale or a model that cannot be loaded clears the scales
+        rippleDetector->setScales(scalesText->getText());
+        scalesText->setText(rippleDetector->getScales(), dontSendNotification);
+    } else if (labelThatHasChanged == prefilterText) {
+        float newPrefilter;
+
+        if (updateFloatLabel(labelThatHasChanged, 0., 100., rippleDetector->getPrefilter(), &newPrefilter)) {
+            rippleDetector->setPrefilter(newPrefilter);
+        }
+    } else if (labelThatHasChanged == earlyText) {
+        float newEarlyHorizon;
+
+        if (updateFloatLabel(labelThatHasChanged, 0., 1000., rippleDetector->getEarlyTrigger(), &newEarlyHorizon)) {
+            rippleDetector->setEarlyTrigger(newEarlyHorizon);
+        }
     } else if (labelThatHasChanged == thrDriftText) {
         float newThrDrift;
 
@@ -273,6 +499,68 @@ void MultiDetectorEditor::comboBoxChanged(ComboBox* comboBoxThatHasChanged)
 
         rippleDetector->setChannel2(idx - 1);
     }
+
+    else if (comboBoxThatHasChanged == engineSelector)
+    {
+        // The detector reloads the current model with the selected engine
+        if (!rippleDetector->setBackend(engineSelector->getSelectedId()))
+            fileNameLabel->setText("No file selected.", dontSendNotification);
+
+        CoreServices::updateSignalChain(this);
+    }
+
+    else if (comboBoxThatHasChanged == filterSelector)
+    {
+        rippleDetector->setFilterLength(filterSelector->getSelectedId() - 1);
+    }
+
+    else if (comboBoxThatHasChanged == fusionSelector)
+    {
+        rippleDetector->setFusion(fusionSelector->getSelectedId());
+    }
+
+    else if (comboBoxThatHasChanged == journalSelector)
+    {
+        rippleDetector->setJournal(journalSelector->getSelectedId() == 2);
+    }
+
+    else if (comboBoxThatHasChanged == probabilitySelector)
+    {
+        // The channels are added when the signal chain is updated
+        rippleDetector->setProbabilityOutput(probabilitySelector->getSelectedId() == 2);
+        CoreServices::updateSignalChain(this);
+    }
+
+    else if (comboBoxThatHasChanged == streamingSelector)
+    {
+        rippleDetector->setStreaming(streamingSelector->getSelectedId() == 2);
+    }
+
+    else if (comboBoxThatHasChanged == modeSelector)
+    {
+        rippleDetector->setAsync(modeSelector->getSelectedId() == 2);
+        rippleDetector->setBatch(modeSelector->getSelectedId() == 3);
+    }
+
+    else if (comboBoxThatHasChanged == autoTuneSelector || comboBoxThatHasChanged == perSessionThreadsSelector)
+    {
+        updateSessionOptions();
+    }
+}
+
+
+void MultiDetectorEditor::updateSessionOptions()
+{
+    // The detector reloads the session, so the model label and the tuned values are refreshed
+    if (!rippleDetector->setSessionOptions(intraOpThreadsText->getText().getIntValue(), interOpThreadsText->getText().getIntValue(),
+                                           perSessionThreadsSelector->getSelectedId() == 2, autoTuneSelector->getSelectedId() == 2))
+        fileNameLabel->setText("No file selected.", dontSendNotification);
+
+    intraOpThreadsText->setText(String(rippleDetector->getIntraOpThreads()), dontSendNotification);
+    interOpThreadsText->setText(String(rippleDetector->getInterOpThreads()), dontSendNotification);
+    perSessionThreadsSelector->setSelectedId(rippleDetector->getPerSessionThreads() ? 2 : 1, dontSendNotification);
+
+    CoreServices::updateSignalChain(this);
 }
 
 
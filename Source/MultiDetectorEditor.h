@@ -22,6 +22,9 @@ public:
     void comboBoxChanged(ComboBox* comboBoxThatHasChanged) override;
     void buttonEvent(Button* button) override;
 
+    void startAcquisition() override;
+    void stopAcquisition() override;
+
 private:
 	MultiDetectorSpace::MultiDetector * rippleDetector;
 
@@ -31,10 +34,19 @@ private:
 	ScopedPointer<UtilityButton> fileButton;
   ScopedPointer<Label> fileNameLabel;
 
+  ScopedPointer<Label> warmUpLabel;
+  ScopedPointer<Label> warmUpText;
+  ScopedPointer<Label> engineLabel;
+  ScopedPointer<ComboBox> engineSelector;
+  ScopedPointer<Label> modeLabel;
+  ScopedPointer<ComboBox> modeSelector;
+
   ScopedPointer<Label> windowSizeLabel;
   ScopedPointer<Label> windowSizeText;
   ScopedPointer<Label> strideLabel;
   ScopedPointer<Label> strideText;
+  ScopedPointer<Label> streamingLabel;
+  ScopedPointer<ComboBox> streamingSelector;
 
   ScopedPointer<Label> pulseDurationLabel;
   ScopedPointer<Label> timeoutLabel;
@@ -58,6 +70,32 @@ private:
   ScopedPointer<Label> thrDriftLabel;
   ScopedPointer<Label> thrDriftText;
 
+  ScopedPointer<Label> autoTuneLabel;
+  ScopedPointer<ComboBox> autoTuneSelector;
+  ScopedPointer<Label> threadsLabel;
+  ScopedPointer<Label> intraOpThreadsText;
+  ScopedPointer<Label> interOpThreadsText;
+  ScopedPointer<Label> perSessionThreadsLabel;
+  ScopedPointer<ComboBox> perSessionThreadsSelector;
+
+  ScopedPointer<Label> filterLabel;
+  ScopedPointer<ComboBox> filterSelector;
+
+  ScopedPointer<Label> scalesLabel;
+  ScopedPointer<Label> scalesText;
+  ScopedPointer<Label> fusionLabel;
+  ScopedPointer<ComboBox> fusionSelector;
+
+  ScopedPointer<Label> prefilterLabel;
+  ScopedPointer<Label> prefilterText;
+
+  ScopedPointer<Label> probabilityLabel;
+  ScopedPointer<ComboBox> probabilitySelector;
+  ScopedPointer<Label> earlyLabel;
+  ScopedPointer<Label> earlyText;
+  ScopedPointer<Label> journalLabel;
+  ScopedPointer<ComboBox> journalSelector;
+
   Label * createLabel(const String& name, const String& text, juce::Rectangle<int> bounds);
   Label * createTextField(const String& name, const String& initialValue, const String& tooltip, juce::Rectangle<int> bounds);
 
@@ -66,6 +104,7 @@ private:
   bool updateStringLabel(Label* label, String defaultValue, String& out);
 
   void setFile(String file);
+  void updateSessionOptions();
 
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MultiDetectorEditor);
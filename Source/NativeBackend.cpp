@@ -0,0 +1,175 @@
+#include "NativeBackend.h"
+#include <cstdio>
+#include <algorithm>
+
+using namespace MultiDetectorSpace;
+
+
+NativeBackend::NativeBackend(bool useSimd, bool quantized) : useSimd(useSimd), quantized(quantized)
+{
+}
+
+NativeBackend::~NativeBackend()
+{
+	stopQuantizer();
+}
+
+const char* NativeBackend::getName() const
+{
+	if (quantized) return "Native INT8";
+	return useSimd ? "Native" : "Reference";
+}
+
+bool NativeBackend::load(const std::string& modelPath)
+{
+	if (cnn_functions::load_model(modelPath.c_str(), &model) != 0) {
+		printf("Can't load native model\n");
+		return false;
+	}
+
+	model.use_simd = useSimd && cnn_functions::cpu_supports_simd();
+	inputLayer = model.layers[0];
+	return true;
+}
+
+bool NativeBackend::setInputNormalization(const float* means, const float* stds)
+{
+	// Raw samples keep their offsets, which would waste most of the INT8 input range
+	if (quantized) return false;
+
+	model.layers[0] = inputLayer;
+	cnn_functions::fold_input_normalization(&model.layers[0], means, stds);
+	return true;
+}
+
+int NativeBackend::getInputChannels() const
+{
+	return model.layers.empty() ? 0 : model.layers[0].in_channels;
+}
+
+
+bool NativeBackend::prepare(int newWindowSteps, int)
+{
+	windowSteps = newWindowSteps;
+	outputSize = int(cnn_functions::model_output_steps(model, windowSteps) * model.layers.back().out_channels);
+	if (outputSize == 0) {
+		printf("Window too short for the model\n");
+		return false;
+	}
+
+	cnn_functions::reserve_model(&model, windowSteps);
+
+	// Quantization starts over with the windows of every acquisition, once the previous one is done
+	stopQuantizer();
+	quantizedReady = false;
+	calibrating = quantized;
+	calibrationWindowCount = 0;
+	if (calibrating) {
+		calibrationWindows.assign(std::size_t(QUANT_CALIBRATION_WINDOWS) * windowSteps * getInputChannels(), 0.f);
+		quantizerModel = model;
+		calibrationFull = false;
+		quantizerExit = false;
+		quantizerThread = std::thread(&NativeBackend::quantize, this);
+	}
+
+	return true;
+}
+
+
+bool NativeBackend::infer(const float* windows, int numWindows, float* output)
+{
+	std::size_t windowValues = std::size_t(windowSteps) * getInputChannels();
+
+	for (int w = 0; w < numWindows; w++) {
+		const float* window = windows + w * windowValues;
+
+		if (quantizedReady.load(std::memory_order_acquire)) {
+			if (cnn_functions::run_quantized(&quantizedModel, window, windowSteps, output + w * outputSize) != 0) return false;
+			continue;
+		}
+
+		if (cnn_functions::run_model(&model, window, windowSteps, output + w * outputSize) != 0) return false;
+
+		if (calibrating && !warmingUp) {
+			// Windows run in float until there are enough to calibrate and validate the INT8 model
+			std::copy(window, window + windowValues, calibrationWindows.begin() + calibrationWindowCount * windowValues);
+			if (++calibrationWindowCount == QUANT_CALIBRATION_WINDOWS) {
+				// The quantizer takes over, windows keep running in float until the INT8 model is ready
+				calibrating = false;
+				{
+					std::lock_guard<std::mutex> lock(quantizerMutex);
+					calibrationFull = true;
+				}
+				quantizerCondition.notify_one();
+			}
+		}
+	}
+
+	return true;
+}
+
+
+void NativeBackend::quantize()
+{
+	unsigned int numCalibration = QUANT_CALIBRATION_WINDOWS / 2;
+	unsigned int numValidation = QUANT_CALIBRATION_WINDOWS - numCalibration;
+	const float* validation = calibrationWindows.data() + std::size_t(numCalibration) * windowSteps * getInputChannels();
+	cnn_functions::quantization_report report;
+
+	{
+		std::unique_lock<std::mutex> lock(quantizerMutex);
+		quantizerCondition.wait(lock, [this] { return calibrationFull || quantizerExit; });
+		if (!calibrationFull) return;
+	}
+
+	// A failed quantization keeps running in float
+	if (cnn_functions::quantize_model(&quantizerModel, calibrationWindows.data(), numCalibration, windowSteps, &quantizedModel) != 0 ||
+		cnn_functions::compare_quantized(&quantizerModel, &quantizedModel, validation, numValidation, windowSteps, reportThreshold, &report) != 0) {
+		printf("Can't quantize native model, using float.\n");
+		return;
+	}
+
+	printf("INT8 validation on %u windows: %u float detections, %u INT8 detections, %u in both. Probability error mean %f max %f\n",
+		unsigned(report.windows), unsigned(report.float_detections), unsigned(report.quantized_detections), unsigned(report.common_detections),
+		report.mean_error, report.max_error);
+
+	quantizedReady.store(true, std::memory_order_release);
+}
+
+
+void NativeBackend::stopQuantizer()
+{
+	if (!quantizerThread.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(quantizerMutex);
+		quantizerExit = true;
+	}
+	quantizerCondition.notify_one();
+	quantizerThread.join();
+}
+
+
+bool NativeBackend::startStream()
+{
+	// The INT8 model has no streaming path
+	if (quantized) return false;
+
+	return cnn_functions::create_stream(model, windowSteps, &stream) == 0;
+}
+
+void NativeBackend::resetStream()
+{
+	cnn_functions::reset_stream(&stream);
+}
+
+void NativeBackend::pushStream(const float* row)
+{
+	cnn_functions::push_stream(model, &stream, row);
+}
+
+bool NativeBackend::inferStream(float* output)
+{
+	// Until the stream holds a full window the caller runs the whole window
+	return cnn_functions::run_stream(&model, &stream, output) == 0;
+}
@@ -0,0 +1,73 @@
+#ifndef NATIVEBACKEND_H_DEFINED
+#define NATIVEBACKEND_H_DEFINED
+
+#include "InferenceBackend.h"
+#include "cnn_functions.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define QUANT_CALIBRATION_WINDOWS 512 // Half calibrate the INT8 scales, half validate them against the float model
+
+namespace MultiDetectorSpace
+{
+	/**
+	Runs the model with the built-in engine of cnn_functions.
+
+	useSimd selects the AVX2/FMA kernels when the CPU has them, otherwise the scalar reference kernels are used.
+	With quantized, the first windows after prepare() run in float and are collected to calibrate an INT8 copy of
+	the model. A thread started by prepare() quantizes and validates it, so infer() never allocates, and the INT8
+	model runs every window after that.
+	*/
+	class NativeBackend : public InferenceBackend
+	{
+	public:
+		NativeBackend(bool useSimd, bool quantized);
+		~NativeBackend();
+
+		const char* getName() const override;
+		bool load(const std::string& modelPath) override;
+		bool prepare(int windowSteps, int maxWindows) override;
+		bool infer(const float* windows, int numWindows, float* output) override;
+		int getInputChannels() const override;
+		int getOutputSize() const override { return outputSize; }
+		void setThreshold(float threshold) override { reportThreshold = threshold; }
+		bool setInputNormalization(const float* means, const float* stds) override;
+
+		bool startStream() override;
+		void resetStream() override;
+		void pushStream(const float* row) override;
+		bool inferStream(float* output) override;
+
+	private:
+		void quantize();
+		void stopQuantizer();
+
+		bool useSimd;
+		bool quantized;
+
+		cnn_functions::model model;
+		cnn_functions::layer inputLayer; // First layer as loaded, before any normalization is folded in
+		cnn_functions::stream stream;
+		int windowSteps = 0;
+		int outputSize = 0;
+
+		cnn_functions::quantized_model quantizedModel; // Owned by the quantizer until quantizedReady is set
+		std::atomic<bool> quantizedReady{false};
+		bool calibrating = false;
+		std::vector<float> calibrationWindows;
+		unsigned int calibrationWindowCount = 0;
+
+		// The quantizer runs its own copy of the float model, so the scratch activations of infer() are not shared
+		cnn_functions::model quantizerModel;
+		std::thread quantizerThread;
+		std::mutex quantizerMutex;
+		std::condition_variable quantizerCondition;
+		bool calibrationFull = false; // Guarded by quantizerMutex
+		bool quantizerExit = false;   // Guarded by quantizerMutex
+		float reportThreshold = 0.5f;
+	};
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef SPSCQUEUE_H_DEFINED
+#define SPSCQUEUE_H_DEFINED
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace MultiDetectorSpace
+{
+	/**
+	Lock-free single-producer/single-consumer queue over a fixed ring of pre-allocated slots.
+
+	Items are copy-assigned into and out of the slots, so types whose containers keep the same
+	size (windows, output vectors) never allocate once reset() has been called.
+	*/
+	template <typename T>
+	class SpscQueue
+	{
+	public:
+		SpscQueue() : head(0), tail(0), mask(0) {}
+
+		/** Allocates capacity slots (rounded up to a power of two) initialized to prototype. Not thread safe. */
+		void reset(std::size_t capacity, const T& prototype)
+		{
+			std::size_t size = 1;
+			while (size < capacity) size <<= 1;
+
+			slots.assign(size, prototype);
+			mask = size - 1;
+			head.store(0);
+			tail.store(0);
+		}
+
+		/** Producer side. Returns false if the queue is full. */
+		bool push(const T& item)
+		{
+			std::size_t t = tail.load(std::memory_order_relaxed);
+			if (slots.empty() || t - head.load(std::memory_order_acquire) > mask) return false;
+
+			slots[t & mask] = item;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		/** Consumer side. Returns false if the queue is empty. */
+		bool pop(T& item)
+		{
+			std::size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return false;
+
+			item = slots[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		std::size_t size() const
+		{
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+	private:
+		std::vector<T> slots;
+
+		// Padded onto separate cache lines so producer and consumer do not false-share
+		char padding0[64];
+		std::atomic<std::size_t> head;
+		char padding1[64];
+		std::atomic<std::size_t> tail;
+		char padding2[64];
+		std::size_t mask;
+	};
+}
+
+#endif
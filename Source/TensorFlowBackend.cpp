@@ -0,0 +1,131 @@
+#include "TensorFlowBackend.h"
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+using namespace MultiDetectorSpace;
+
+
+TensorFlowBackend::TensorFlowBackend(const std::string& inputLayer, const tf_functions::session_options& options, bool autoTune, int tuneWindowSteps)
+	: inputLayer(inputLayer), options(options), autoTune(autoTune), tuneWindowSteps(tuneWindowSteps)
+{
+}
+
+TensorFlowBackend::~TensorFlowBackend()
+{
+	release();
+}
+
+void TensorFlowBackend::release()
+{
+	for (std::size_t b = 0; b < pools.size(); b++) {
+		tf_functions::delete_tensor_pool(&pools[b]);
+	}
+	pools.clear();
+
+	if (session != nullptr) tf_functions::delete_session(session);
+	if (graph != nullptr) tf_functions::delete_graph(graph);
+	session = nullptr;
+	graph = nullptr;
+}
+
+
+bool TensorFlowBackend::load(const std::string& modelPath)
+{
+	release();
+	coldLatency = -1.;
+
+	// serving_default_conv1d_input
+	// serving_default_input_1
+	std::string inputName = "serving_default_" + inputLayer;
+	std::string outputName = "StatefulPartitionedCall";
+
+	if (tf_functions::load_session(modelPath.c_str(), &graph, &session, options) != 0) {
+		return false;
+	}
+
+	input = TF_Output{ TF_GraphOperationByName(graph, inputName.c_str()), 0 };
+	if (input.oper == nullptr) {
+		printf("Can't init input_op\n");
+		return false;
+	}
+
+	output = TF_Output{ TF_GraphOperationByName(graph, outputName.c_str()), 0 };
+	if (output.oper == nullptr) {
+		printf("Can't init output_op\n");
+		return false;
+	}
+
+	// The input is [batch][steps][channels], only the channels are fixed by the model
+	std::vector<std::int64_t> dims;
+	if (tf_functions::get_tensor_shape(graph, &input, dims) != 0 || dims.size() != 3 || dims[2] <= 0) {
+		printf("Can't get the number of input channels\n");
+		return false;
+	}
+	inputChannels = int(dims[2]);
+
+	if (autoTune) {
+		// Candidates are benchmarked on their own sessions, then the model is loaded again with the fastest
+		std::vector<std::int64_t> tuneDims = { 1, tuneWindowSteps, inputChannels };
+		release();
+		tf_functions::tune_session(modelPath.c_str(), inputName.c_str(), outputName.c_str(), tuneDims.data(), tuneDims.size(), 200, &options);
+
+		if (tf_functions::load_session(modelPath.c_str(), &graph, &session, options) != 0) {
+			return false;
+		}
+		input = TF_Output{ TF_GraphOperationByName(graph, inputName.c_str()), 0 };
+		output = TF_Output{ TF_GraphOperationByName(graph, outputName.c_str()), 0 };
+	}
+
+	return true;
+}
+
+
+bool TensorFlowBackend::prepare(int newWindowSteps, int maxWindows)
+{
+	windowSteps = newWindowSteps;
+
+	// The batch dimension of the model is dynamic, so there is one input tensor per batch size. The ones of
+	// batch sizes no longer used are freed, the others are replaced
+	for (std::size_t b = std::size_t(maxWindows); b < pools.size(); b++) {
+		tf_functions::delete_tensor_pool(&pools[b]);
+	}
+	pools.resize(maxWindows);
+	for (int b = 0; b < maxWindows; b++) {
+		std::vector<std::int64_t> dims = { b + 1, windowSteps, inputChannels };
+		if (tf_functions::create_tensor_pool(TF_FLOAT, dims, dims.size(), &pools[b]) != 0) {
+			printf("Can't allocate input tensor.\n");
+			return false;
+		}
+	}
+
+	// The graph does not give the number of output steps, so one window is run to get it
+	auto start = std::chrono::steady_clock::now();
+	if (tf_functions::run_session(session, &input, &output, &pools[0]) != 0) {
+		return false;
+	}
+	// Only the first run of the session is cold, later prepare() calls run it warm
+	if (coldLatency < 0.) coldLatency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	outputSize = int(pools[0].output_size);
+
+	return true;
+}
+
+
+bool TensorFlowBackend::infer(const float* windows, int numWindows, float* outputData)
+{
+	tf_functions::tensor_pool& pool = pools[numWindows - 1];
+
+	// The windows are spans of the round buffer, already normalized, and are copied into the pooled tensor. A tensor
+	// over the span itself would need a TF_NewTensor per run, which allocates, while the copy is a few KB next to
+	// the session run
+	float* tensorInput = static_cast<float*>(tf_functions::tensor_pool_input(&pool));
+	std::copy(windows, windows + std::size_t(numWindows) * windowSteps * inputChannels, tensorInput);
+
+	if (tf_functions::run_session(session, &input, &output, &pool) != 0) {
+		return false;
+	}
+
+	std::copy(pool.output_data.begin(), pool.output_data.begin() + std::size_t(numWindows) * outputSize, outputData);
+	return true;
+}
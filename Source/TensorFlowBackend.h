@@ -0,0 +1,48 @@
+#ifndef TENSORFLOWBACKEND_H_DEFINED
+#define TENSORFLOWBACKEND_H_DEFINED
+
+#include "InferenceBackend.h"
+#include "tf_functions.hpp"
+
+namespace MultiDetectorSpace
+{
+	/** Runs the SavedModel through the TensorFlow C API */
+	class TensorFlowBackend : public InferenceBackend
+	{
+	public:
+		/** inputLayer is the Keras name of the input layer. With autoTune the threading options are benchmarked
+		on windows of tuneWindowSteps rows when the model is loaded */
+		TensorFlowBackend(const std::string& inputLayer, const tf_functions::session_options& options, bool autoTune, int tuneWindowSteps);
+		~TensorFlowBackend();
+
+		const char* getName() const override { return "TensorFlow"; }
+		bool load(const std::string& modelPath) override;
+		bool prepare(int windowSteps, int maxWindows) override;
+		bool infer(const float* windows, int numWindows, float* output) override;
+		int getInputChannels() const override { return inputChannels; }
+		int getOutputSize() const override { return outputSize; }
+
+		/** Options the session was created with, the tuned ones when autoTune is set */
+		const tf_functions::session_options& getSessionOptions() const { return options; }
+
+	private:
+		void release();
+
+		std::string inputLayer;
+		tf_functions::session_options options;
+		bool autoTune;
+		int tuneWindowSteps;
+
+		TF_Graph * graph = nullptr;
+		TF_Session * session = nullptr;
+		TF_Output input, output;
+
+		// Input tensors allocated once, one per batch size. The C API allocates the outputs on every run
+		std::vector<tf_functions::tensor_pool> pools;
+		int windowSteps = 0;
+		int inputChannels = 0;
+		int outputSize = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef TTLSCHEDULER_H_DEFINED
+#define TTLSCHEDULER_H_DEFINED
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace MultiDetectorSpace
+{
+	/**
+	Pending TTL transitions (an output line going on or off at a timestamp) for any number of lines.
+
+	Transitions are kept on a timing wheel: each slot holds the transitions of 2^slotShift consecutive samples, so
+	scheduling is O(1) and emitting a buffer only visits the slots it spans. Transitions further ahead than the
+	wheel wait in an overflow list until they come within reach. Entries come from a pool allocated by reset(),
+	so nothing allocates afterwards.
+	*/
+	class TtlScheduler
+	{
+	public:
+		TtlScheduler() : slotShift(0), slotMask(0), freeEntries(-1), numFree(0), overflow(-1), cursor(0) {}
+
+		/** Allocates capacity entries and numSlots slots (rounded up to a power of two), and drops anything pending.
+		Transitions before start are emitted by the first popDue(). Not real-time safe */
+		void reset(std::size_t capacity, int newSlotShift, std::size_t numSlots, std::int64_t start)
+		{
+			std::size_t size = 1;
+			while (size < numSlots) size <<= 1;
+
+			slotShift = newSlotShift;
+			slotMask = size - 1;
+			heads.assign(size, -1);
+			tails.assign(size, -1);
+			entries.assign(capacity, Entry());
+			for (std::size_t idx = 0; idx < capacity; idx++) {
+				entries[idx].next = (idx + 1 < capacity) ? int(idx + 1) : -1;
+			}
+			freeEntries = capacity > 0 ? 0 : -1;
+			numFree = capacity;
+			overflow = -1;
+			cursor = start;
+		}
+
+		/** Returns false if the pool is full and the transition is dropped */
+		bool schedule(std::int64_t timestamp, int line, bool state)
+		{
+			if (freeEntries < 0) return false;
+
+			int idx = freeEntries;
+			Entry& entry = entries[idx];
+			freeEntries = entry.next;
+			numFree--;
+			entry.timestamp = timestamp;
+			entry.line = line;
+			entry.state = state;
+			entry.next = -1;
+
+			place(idx);
+			return true;
+		}
+
+		/** Transitions that can still be scheduled */
+		std::size_t available() const { return numFree; }
+
+		/** Calls emit(timestamp, line, state) for every transition before end, in timestamp order. Transitions with the
+		same timestamp may come in any order */
+		template <typename F>
+		void popDue(std::int64_t end, F emit)
+		{
+			// At most one turn of the wheel at a time, so the overflow is placed before its turn comes
+			while (cursor < end) {
+				if (numFree == entries.size()) {
+					// Nothing pending, the wheel can jump ahead
+					cursor = end;
+					return;
+				}
+
+				std::int64_t firstSlot = cursor >> slotShift;
+				std::int64_t stepEnd = std::min(end, (firstSlot + std::int64_t(slotMask) + 1) << slotShift);
+				std::int64_t lastSlot = (stepEnd - 1) >> slotShift;
+				cursor = stepEnd;
+
+				for (std::int64_t slot = firstSlot; slot <= lastSlot; slot++) {
+					std::size_t wheelSlot = std::size_t(slot) & slotMask;
+					int idx = heads[wheelSlot];
+					heads[wheelSlot] = -1;
+					tails[wheelSlot] = -1;
+
+					while (idx >= 0) {
+						Entry& entry = entries[idx];
+						int next = entry.next;
+
+						if (entry.timestamp >= stepEnd) {
+							// Later in the last slot, it stays for the next call. The rest of the slot is later too
+							heads[wheelSlot] = idx;
+							while (entries[idx].next >= 0) idx = entries[idx].next;
+							tails[wheelSlot] = idx;
+							break;
+						}
+
+						emit(entry.timestamp, entry.line, entry.state);
+						entry.next = freeEntries;
+						freeEntries = idx;
+						numFree++;
+						idx = next;
+					}
+				}
+
+				// The wheel has moved on, so some of the overflow may fit now
+				int idx = overflow;
+				overflow = -1;
+				while (idx >= 0) {
+					int next = entries[idx].next;
+					entries[idx].next = -1;
+					place(idx);
+					idx = next;
+				}
+			}
+		}
+
+	private:
+		struct Entry
+		{
+			Entry() : timestamp(0), line(0), state(false), next(-1) {}
+
+			std::int64_t timestamp;
+			int line;
+			bool state;
+			int next; // Next entry of the same slot, overflow or free list
+		};
+
+		void place(int idx)
+		{
+			// Late transitions go to the slot emitted next
+			std::int64_t slot = std::max(entries[idx].timestamp, cursor) >> slotShift;
+
+			if (slot - (cursor >> slotShift) > std::int64_t(slotMask)) {
+				entries[idx].next = overflow;
+				overflow = idx;
+				return;
+			}
+			insert(std::size_t(slot) & slotMask, idx);
+		}
+
+		// Keeps each slot sorted by timestamp. Transitions are mostly scheduled in order, so they usually go at the tail
+		void insert(std::size_t wheelSlot, int idx)
+		{
+			std::int64_t timestamp = entries[idx].timestamp;
+
+			if (tails[wheelSlot] < 0) {
+				heads[wheelSlot] = idx;
+				tails[wheelSlot] = idx;
+			}
+			else if (entries[tails[wheelSlot]].timestamp <= timestamp) {
+				entries[tails[wheelSlot]].next = idx;
+				tails[wheelSlot] = idx;
+			}
+			else if (entries[heads[wheelSlot]].timestamp > timestamp) {
+				entries[idx].next = heads[wheelSlot];
+				heads[wheelSlot] = idx;
+			}
+			else {
+				int prev = heads[wheelSlot];
+				while (entries[entries[prev].next].timestamp <= timestamp) prev = entries[prev].next;
+				entries[idx].next = entries[prev].next;
+				entries[prev].next = idx;
+			}
+		}
+
+		std::vector<Entry> entries;
+		std::vector<int> heads; // First and last entry of each slot, -1 if empty
+		std::vector<int> tails;
+		int slotShift;
+		std::size_t slotMask;
+		int freeEntries;
+		std::size_t numFree;
+		int overflow;
+		std::int64_t cursor; // Transitions before this timestamp have been emitted
+	};
+}
+
+#endif
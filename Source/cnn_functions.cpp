@@ -0,0 +1,1122 @@
+#include "cnn_functions.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CNN_FUNCTIONS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CNN_TARGET_AVX2
+#else
+#define CNN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+#define SIMD_WIDTH 8
+#define TABLE_FOOTER_SIZE 48
+#define TABLE_MAGIC 0xdb4775248b80fb57ull
+#define DT_FLOAT 1
+#define INT8_MAX_VALUE 127
+
+
+namespace cnn_functions {
+
+	namespace {
+
+		/* ------------- Tensor bundle (checkpoint) reader ------------- */
+
+		struct bundle_entry {
+			int dtype = 0;
+			std::vector<std::int64_t> shape;
+			int shard_id = 0;
+			std::uint64_t offset = 0;
+			std::uint64_t size = 0;
+		};
+
+		struct bundle {
+			std::string prefix;
+			int num_shards = 1;
+			std::map<std::string, bundle_entry> entries;
+			std::map<int, std::string> shards;
+		};
+
+		bool read_file (const std::string& path, std::string& out) {
+			std::ifstream f(path, std::ios::binary);
+			if (!f) return false;
+
+			std::ostringstream ss;
+			ss << f.rdbuf();
+			out = ss.str();
+			return true;
+		}
+
+		bool read_varint (const std::string& b, std::size_t& p, std::size_t end, std::uint64_t& v) {
+			v = 0;
+			for (int shift = 0; p < end && shift < 64; shift += 7) {
+				std::uint8_t c = static_cast<std::uint8_t>(b[p++]);
+				v |= std::uint64_t(c & 0x7f) << shift;
+				if (c < 0x80) return true;
+			}
+			return false;
+		}
+
+		std::uint32_t read_fixed32 (const std::string& b, std::size_t p) {
+			std::uint32_t v;
+			std::memcpy(&v, b.data() + p, sizeof(v));
+			return v;
+		}
+
+		// Skips a protobuf field of the given wire type
+		bool skip_field (const std::string& b, std::size_t& p, std::size_t end, int wire_type) {
+			std::uint64_t v;
+			switch (wire_type) {
+			case 0: return read_varint(b, p, end, v);
+			case 1: p += 8; return p <= end;
+			case 2: if (!read_varint(b, p, end, v)) return false; p += v; return p <= end;
+			case 5: p += 4; return p <= end;
+			default: return false;
+			}
+		}
+
+		// Decodes the key/value pairs of one (uncompressed) table block
+		bool parse_block (const std::string& file, std::uint64_t offset, std::uint64_t size, std::vector<std::pair<std::string, std::string>>& out) {
+			if (offset + size + 5 > file.size() || size < 4) return false;
+			if (file[offset + size] != 0) {
+				fprintf(stderr, "ERROR: Compressed checkpoint blocks are not supported\n");
+				return false;
+			}
+
+			std::uint32_t num_restarts = read_fixed32(file, offset + size - 4);
+			if (4 + 4 * std::uint64_t(num_restarts) > size) return false;
+			std::size_t end = offset + size - 4 - 4 * num_restarts;
+
+			std::size_t p = offset;
+			std::string key;
+			while (p < end) {
+				std::uint64_t shared, non_shared, value_length;
+				if (!read_varint(file, p, end, shared) || !read_varint(file, p, end, non_shared) || !read_varint(file, p, end, value_length)) return false;
+				if (shared > key.size() || p + non_shared + value_length > end) return false;
+
+				key = key.substr(0, shared) + file.substr(p, non_shared);
+				p += non_shared;
+				out.emplace_back(key, file.substr(p, value_length));
+				p += value_length;
+			}
+			return true;
+		}
+
+		bool parse_shape (const std::string& b, std::vector<std::int64_t>& shape) {
+			std::size_t p = 0, end = b.size();
+			while (p < end) {
+				std::uint64_t tag;
+				if (!read_varint(b, p, end, tag)) return false;
+
+				if ((tag >> 3) == 2 && (tag & 7) == 2) {
+					std::uint64_t len, dim_size = 0;
+					if (!read_varint(b, p, end, len) || p + len > end) return false;
+
+					std::size_t q = p, dim_end = p + len;
+					while (q < dim_end) {
+						std::uint64_t dim_tag;
+						if (!read_varint(b, q, dim_end, dim_tag)) return false;
+						if ((dim_tag >> 3) == 1 && (dim_tag & 7) == 0) {
+							if (!read_varint(b, q, dim_end, dim_size)) return false;
+						}
+						else if (!skip_field(b, q, dim_end, dim_tag & 7)) return false;
+					}
+					shape.push_back(static_cast<std::int64_t>(dim_size));
+					p = dim_end;
+				}
+				else if (!skip_field(b, p, end, tag & 7)) return false;
+			}
+			return true;
+		}
+
+		// BundleEntryProto: dtype(1) shape(2) shard_id(3) offset(4) size(5)
+		bool parse_entry (const std::string& b, bundle_entry& e) {
+			std::size_t p = 0, end = b.size();
+			while (p < end) {
+				std::uint64_t tag, v;
+				if (!read_varint(b, p, end, tag)) return false;
+				int field = int(tag >> 3), wire_type = int(tag & 7);
+
+				if (wire_type == 0 && field != 2) {
+					if (!read_varint(b, p, end, v)) return false;
+					if (field == 1) e.dtype = int(v);
+					else if (field == 3) e.shard_id = int(v);
+					else if (field == 4) e.offset = v;
+					else if (field == 5) e.size = v;
+				}
+				else if (field == 2 && wire_type == 2) {
+					if (!read_varint(b, p, end, v) || p + v > end) return false;
+					if (!parse_shape(b.substr(p, v), e.shape)) return false;
+					p += v;
+				}
+				else if (!skip_field(b, p, end, wire_type)) return false;
+			}
+			return true;
+		}
+
+		int read_bundle (const std::string& prefix, bundle& bnd) {
+			std::string index;
+			if (!read_file(prefix + ".index", index) || index.size() < TABLE_FOOTER_SIZE) {
+				fprintf(stderr, "ERROR: Unable to read %s.index\n", prefix.c_str());
+				return -1;
+			}
+
+			std::size_t p = index.size() - TABLE_FOOTER_SIZE;
+			std::uint64_t magic;
+			std::memcpy(&magic, index.data() + index.size() - 8, sizeof(magic));
+			std::uint64_t meta_offset, meta_size, index_offset, index_size;
+			if (magic != TABLE_MAGIC ||
+				!read_varint(index, p, index.size(), meta_offset) || !read_varint(index, p, index.size(), meta_size) ||
+				!read_varint(index, p, index.size(), index_offset) || !read_varint(index, p, index.size(), index_size)) {
+				fprintf(stderr, "ERROR: Invalid checkpoint index %s.index\n", prefix.c_str());
+				return -1;
+			}
+
+			std::vector<std::pair<std::string, std::string>> handles;
+			if (!parse_block(index, index_offset, index_size, handles)) {
+				fprintf(stderr, "ERROR: Invalid checkpoint index block\n");
+				return -1;
+			}
+
+			for (const auto& handle : handles) {
+				std::size_t q = 0;
+				std::uint64_t block_offset, block_size;
+				std::vector<std::pair<std::string, std::string>> records;
+				if (!read_varint(handle.second, q, handle.second.size(), block_offset) ||
+					!read_varint(handle.second, q, handle.second.size(), block_size) ||
+					!parse_block(index, block_offset, block_size, records)) {
+					fprintf(stderr, "ERROR: Invalid checkpoint data block\n");
+					return -1;
+				}
+
+				for (const auto& record : records) {
+					if (record.first.empty()) {
+						// BundleHeaderProto: num_shards(1)
+						std::size_t r = 0;
+						while (r < record.second.size()) {
+							std::uint64_t tag, v = 0;
+							if (!read_varint(record.second, r, record.second.size(), tag)) break;
+							if ((tag & 7) == 0) {
+								if (!read_varint(record.second, r, record.second.size(), v)) break;
+								if ((tag >> 3) == 1) bnd.num_shards = int(v);
+							}
+							else if (!skip_field(record.second, r, record.second.size(), tag & 7)) break;
+						}
+						continue;
+					}
+
+					bundle_entry e;
+					if (!parse_entry(record.second, e)) {
+						fprintf(stderr, "ERROR: Invalid checkpoint entry %s\n", record.first.c_str());
+						return -1;
+					}
+					bnd.entries[record.first] = e;
+				}
+			}
+
+			bnd.prefix = prefix;
+			return 0;
+		}
+
+		int read_variable (bundle& bnd, const std::string& name, std::vector<float>& values, std::vector<std::int64_t>& shape) {
+			std::string key = name + "/.ATTRIBUTES/VARIABLE_VALUE";
+			auto it = bnd.entries.find(key);
+			if (it == bnd.entries.end()) {
+				fprintf(stderr, "ERROR: Variable %s not found in checkpoint\n", key.c_str());
+				return -1;
+			}
+
+			const bundle_entry& e = it->second;
+			if (e.dtype != DT_FLOAT) {
+				fprintf(stderr, "ERROR: Variable %s is not float32\n", key.c_str());
+				return -1;
+			}
+
+			if (bnd.shards.count(e.shard_id) == 0) {
+				char suffix[64];
+				snprintf(suffix, sizeof(suffix), ".data-%05d-of-%05d", e.shard_id, bnd.num_shards);
+				if (!read_file(bnd.prefix + suffix, bnd.shards[e.shard_id])) {
+					fprintf(stderr, "ERROR: Unable to read %s%s\n", bnd.prefix.c_str(), suffix);
+					return -1;
+				}
+			}
+
+			const std::string& data = bnd.shards[e.shard_id];
+			if (e.offset + e.size > data.size()) {
+				fprintf(stderr, "ERROR: Variable %s out of shard bounds\n", key.c_str());
+				return -1;
+			}
+
+			values.resize(e.size / sizeof(float));
+			std::memcpy(values.data(), data.data() + e.offset, values.size() * sizeof(float));
+			shape = e.shape;
+			return 0;
+		}
+
+
+		/* ------------- Keras metadata (minimal JSON scanner) ------------- */
+
+		std::size_t skip_whitespace (const std::string& s, std::size_t p) {
+			while (p < s.size() && (s[p] == ' ' || s[p] == '\n' || s[p] == '\t' || s[p] == '\r')) p++;
+			return p;
+		}
+
+		// Returns the position right after the JSON value starting at p
+		std::size_t skip_value (const std::string& s, std::size_t p) {
+			if (p >= s.size()) return s.size();
+
+			if (s[p] == '"') {
+				for (p++; p < s.size() && s[p] != '"'; p++) {
+					if (s[p] == '\\') p++;
+				}
+				return p + 1;
+			}
+
+			if (s[p] == '{' || s[p] == '[') {
+				int depth = 0;
+				while (p < s.size()) {
+					if (s[p] == '"') {
+						p = skip_value(s, p);
+						continue;
+					}
+					if (s[p] == '{' || s[p] == '[') depth++;
+					if (s[p] == '}' || s[p] == ']') depth--;
+					p++;
+					if (depth == 0) return p;
+				}
+				return s.size();
+			}
+
+			while (p < s.size() && s[p] != ',' && s[p] != '}' && s[p] != ']') p++;
+			return p;
+		}
+
+		// Value of "key" among the direct members of the object obj
+		bool json_member (const std::string& obj, const std::string& key, std::string& value) {
+			std::size_t p = skip_whitespace(obj, 0);
+			if (p >= obj.size() || obj[p] != '{') return false;
+			p++;
+
+			while (true) {
+				p = skip_whitespace(obj, p);
+				if (p >= obj.size() || obj[p] != '"') return false;
+
+				std::size_t key_end = skip_value(obj, p);
+				std::string member = obj.substr(p + 1, key_end - p - 2);
+
+				p = skip_whitespace(obj, key_end);
+				if (p >= obj.size() || obj[p] != ':') return false;
+				p = skip_whitespace(obj, p + 1);
+
+				std::size_t value_end = skip_value(obj, p);
+				if (member == key) {
+					value = obj.substr(p, value_end - p);
+					return true;
+				}
+
+				p = skip_whitespace(obj, value_end);
+				if (p >= obj.size() || obj[p] != ',') return false;
+				p++;
+			}
+		}
+
+		std::vector<std::string> json_elements (const std::string& arr) {
+			std::vector<std::string> elements;
+			std::size_t p = skip_whitespace(arr, 0);
+			if (p >= arr.size() || arr[p] != '[') return elements;
+			p = skip_whitespace(arr, p + 1);
+
+			while (p < arr.size() && arr[p] != ']') {
+				std::size_t end = skip_value(arr, p);
+				elements.push_back(arr.substr(p, end - p));
+				p = skip_whitespace(arr, end);
+				if (p < arr.size() && arr[p] == ',') p = skip_whitespace(arr, p + 1);
+			}
+			return elements;
+		}
+
+		std::string json_string (const std::string& obj, const std::string& key, const std::string& default_value) {
+			std::string value;
+			if (!json_member(obj, key, value) || value.size() < 2 || value[0] != '"') return default_value;
+			return value.substr(1, value.size() - 2);
+		}
+
+		double json_number (const std::string& obj, const std::string& key, double default_value) {
+			std::string value;
+			if (!json_member(obj, key, value)) return default_value;
+			if (value == "true") return 1;
+			if (value == "false") return 0;
+			if (value.empty() || value == "null") return default_value;
+
+			// Tuples are stored either as [n] or as {"class_name": "__tuple__", "items": [n]}
+			std::string items;
+			if (value[0] == '{' && json_member(value, "items", items)) value = items;
+			if (value[0] == '[') {
+				std::vector<std::string> elements = json_elements(value);
+				if (elements.size() != 1) return default_value;
+				value = elements[0];
+			}
+			return std::atof(value.c_str());
+		}
+
+		// Finds the Keras Sequential model configuration stored in saved_model.pb
+		bool read_keras_layers (const std::string& saved_model, std::vector<std::string>& layers) {
+			std::size_t p = saved_model.find("{\"class_name\": \"Sequential\"");
+			if (p == std::string::npos) {
+				fprintf(stderr, "ERROR: Keras Sequential metadata not found in saved_model.pb\n");
+				return false;
+			}
+
+			std::string sequential = saved_model.substr(p, skip_value(saved_model, p) - p);
+			std::string config, layer_list;
+			if (!json_member(sequential, "config", config) || !json_member(config, "layers", layer_list)) {
+				fprintf(stderr, "ERROR: Invalid Keras Sequential metadata\n");
+				return false;
+			}
+
+			layers = json_elements(layer_list);
+			return !layers.empty();
+		}
+
+
+		/* ------------- Model construction ------------- */
+
+		bool parse_activation (const std::string& name, activation_type& activation) {
+			if (name == "linear") activation = ACTIVATION_LINEAR;
+			else if (name == "relu") activation = ACTIVATION_RELU;
+			else if (name == "sigmoid") activation = ACTIVATION_SIGMOID;
+			else {
+				fprintf(stderr, "ERROR: Unsupported activation %s\n", name.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		int pad_channels (int channels) {
+			return ((channels + SIMD_WIDTH - 1) / SIMD_WIDTH) * SIMD_WIDTH;
+		}
+
+		// Keras kernels are [kernel_size][in_channels][out_channels], so only the output axis is padded
+		void set_weights (layer& l, const std::vector<float>& kernel, const std::vector<float>& bias) {
+			int rows = l.kernel_size * l.in_channels;
+			l.out_channels_padded = pad_channels(l.out_channels);
+			l.weights.assign(std::size_t(rows) * l.out_channels_padded, 0.f);
+			l.bias.assign(l.out_channels_padded, 0.f);
+
+			for (int r = 0; r < rows; r++) {
+				for (int c = 0; c < l.out_channels; c++) {
+					l.weights[r * l.out_channels_padded + c] = kernel[r * l.out_channels + c];
+				}
+			}
+			for (int c = 0; c < l.out_channels && c < int(bias.size()); c++) {
+				l.bias[c] = bias[c];
+			}
+		}
+
+		int fold_batch_norm (bundle& bnd, const std::string& name, const std::string& config, layer& l) {
+			std::vector<float> gamma, beta, mean, variance;
+			std::vector<std::int64_t> shape;
+
+			if (read_variable(bnd, name + "/moving_mean", mean, shape) != 0 ||
+				read_variable(bnd, name + "/moving_variance", variance, shape) != 0) return -1;
+			if (json_number(config, "scale", 1) != 0 && read_variable(bnd, name + "/gamma", gamma, shape) != 0) return -1;
+			if (json_number(config, "center", 1) != 0 && read_variable(bnd, name + "/beta", beta, shape) != 0) return -1;
+
+			if (int(mean.size()) != l.out_channels || int(variance.size()) != l.out_channels) {
+				fprintf(stderr, "ERROR: BatchNormalization size mismatch\n");
+				return -1;
+			}
+
+			float epsilon = float(json_number(config, "epsilon", 0.001));
+			int rows = l.kernel_size * l.in_channels;
+			for (int c = 0; c < l.out_channels; c++) {
+				float scale = (gamma.empty() ? 1.f : gamma[c]) / std::sqrt(variance[c] + epsilon);
+				for (int r = 0; r < rows; r++) {
+					l.weights[r * l.out_channels_padded + c] *= scale;
+				}
+				l.bias[c] = (l.bias[c] - mean[c]) * scale + (beta.empty() ? 0.f : beta[c]);
+			}
+			return 0;
+		}
+
+		inline float activate (float x, activation_type activation, float alpha) {
+			switch (activation) {
+			case ACTIVATION_RELU: return x > 0.f ? x : 0.f;
+			case ACTIVATION_LEAKY_RELU: return x > 0.f ? x : alpha * x;
+			case ACTIVATION_SIGMOID: return 1.f / (1.f + std::exp(-x));
+			default: return x;
+			}
+		}
+
+
+		/* ------------- Kernels ------------- */
+
+		// Reduction over the kernel_size * in_channels contiguous inputs of each output step
+		void conv_scalar (const layer& l, const float * in, std::size_t out_steps, float * out) {
+			const int rows = l.kernel_size * l.in_channels;
+			const int padded = l.out_channels_padded;
+
+			for (std::size_t t = 0; t < out_steps; t++) {
+				const float * x = in + t * l.stride * l.in_channels;
+				float * y = out + t * l.out_channels;
+
+				for (int c = 0; c < l.out_channels; c++) {
+					float acc = l.bias[c];
+					for (int r = 0; r < rows; r++) {
+						acc += x[r] * l.weights[r * padded + c];
+					}
+					y[c] = activate(acc, l.activation, l.alpha);
+				}
+			}
+		}
+
+#ifdef CNN_FUNCTIONS_X86
+		// Vectorized over output channels: each input value is broadcast and FMA'd into 8 channels at once
+		CNN_TARGET_AVX2 void conv_avx2 (const layer& l, const float * in, std::size_t out_steps, float * out) {
+			const int rows = l.kernel_size * l.in_channels;
+			const int padded = l.out_channels_padded;
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 alpha = _mm256_set1_ps(l.alpha);
+
+			for (std::size_t t = 0; t < out_steps; t++) {
+				const float * x = in + t * l.stride * l.in_channels;
+				float * y = out + t * l.out_channels;
+
+				for (int j = 0; j < padded; j += SIMD_WIDTH) {
+					const float * w = l.weights.data() + j;
+					__m256 acc0 = _mm256_loadu_ps(l.bias.data() + j);
+					__m256 acc1 = zero;
+
+					int r = 0;
+					for (; r + 1 < rows; r += 2) {
+						acc0 = _mm256_fmadd_ps(_mm256_set1_ps(x[r]), _mm256_loadu_ps(w + r * padded), acc0);
+						acc1 = _mm256_fmadd_ps(_mm256_set1_ps(x[r + 1]), _mm256_loadu_ps(w + (r + 1) * padded), acc1);
+					}
+					if (r < rows) {
+						acc0 = _mm256_fmadd_ps(_mm256_set1_ps(x[r]), _mm256_loadu_ps(w + r * padded), acc0);
+					}
+					__m256 acc = _mm256_add_ps(acc0, acc1);
+
+					if (l.activation == ACTIVATION_RELU) {
+						acc = _mm256_max_ps(acc, zero);
+					}
+					else if (l.activation == ACTIVATION_LEAKY_RELU) {
+						acc = _mm256_blendv_ps(_mm256_mul_ps(acc, alpha), acc, _mm256_cmp_ps(acc, zero, _CMP_GT_OQ));
+					}
+
+					if (j + SIMD_WIDTH <= l.out_channels && l.activation != ACTIVATION_SIGMOID) {
+						_mm256_storeu_ps(y + j, acc);
+					}
+					else {
+						float tmp[SIMD_WIDTH];
+						_mm256_storeu_ps(tmp, acc);
+						for (int c = j; c < l.out_channels && c < j + SIMD_WIDTH; c++) {
+							y[c] = (l.activation == ACTIVATION_SIGMOID) ? activate(tmp[c - j], ACTIVATION_SIGMOID, 0.f) : tmp[c - j];
+						}
+					}
+				}
+			}
+		}
+#endif
+
+		/* ------------- INT8 kernels ------------- */
+
+		inline std::int8_t quantize_value (float x, float inv_scale) {
+			float q = x * inv_scale;
+			q = std::min(std::max(q, float(-INT8_MAX_VALUE)), float(INT8_MAX_VALUE));
+			return std::int8_t(q >= 0.f ? int(q + 0.5f) : int(q - 0.5f));
+		}
+
+		float max_abs (const float * x, std::size_t n) {
+			float m = 0.f;
+			for (std::size_t i = 0; i < n; i++) m = std::max(m, std::fabs(x[i]));
+			return m;
+		}
+
+		float scale_for (float max_value) {
+			return (max_value > 0.f) ? max_value / INT8_MAX_VALUE : 1.f;
+		}
+
+		// Dequantizes, activates and either requantizes for the next layer or writes the float outputs of the last one
+		inline void store_quantized (const quantized_layer& l, int c, float y, std::int8_t * out, float * out_float) {
+			y = activate(y, l.activation, l.alpha);
+			if (l.output_scale > 0.f) out[c] = quantize_value(y, l.output_inv_scale);
+			else out_float[c] = y;
+		}
+
+		// The int8 inputs are widened to int16 once per layer (see run_quantized), so both kernels read them in pairs
+		void conv_quantized_scalar (const quantized_layer& l, const std::int16_t * in, std::size_t out_steps, std::int8_t * out, float * out_float) {
+			const int pairs = l.taps_padded / 2;
+			const int padded = l.out_channels_padded;
+
+			for (std::size_t t = 0; t < out_steps; t++) {
+				const std::int16_t * x = in + t * l.stride * l.in_channels;
+
+				for (int c = 0; c < l.out_channels; c++) {
+					const std::int8_t * w = l.weights.data() + c * 2;
+					std::int32_t acc = 0;
+					for (int p = 0; p < pairs; p++) {
+						acc += x[2 * p] * w[p * padded * 2] + x[2 * p + 1] * w[p * padded * 2 + 1];
+					}
+					store_quantized(l, c, float(acc) * l.scales[c] + l.bias[c], out + t * l.out_channels, out_float + t * l.out_channels);
+				}
+			}
+		}
+
+#ifdef CNN_FUNCTIONS_X86
+		// Same scheme as conv_avx2: each pair of inputs is broadcast and multiplied with the interleaved weights of
+		// 8 output channels by madd, which adds both products into 32-bit accumulators
+		CNN_TARGET_AVX2 void conv_quantized_avx2 (const quantized_layer& l, const std::int16_t * in, std::size_t out_steps, std::int8_t * out, float * out_float) {
+			const int pairs = l.taps_padded / 2;
+			const int padded = l.out_channels_padded;
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 alpha = _mm256_set1_ps(l.alpha);
+			const __m256 inv_scale = _mm256_set1_ps(l.output_inv_scale);
+			const __m256i max_value = _mm256_set1_epi32(INT8_MAX_VALUE);
+			const __m256i min_value = _mm256_set1_epi32(-INT8_MAX_VALUE);
+
+			for (std::size_t t = 0; t < out_steps; t++) {
+				const std::int16_t * x = in + t * l.stride * l.in_channels;
+
+				for (int j = 0; j < padded; j += SIMD_WIDTH) {
+					const std::int8_t * w = l.weights.data() + j * 2;
+					__m256i acc = _mm256_setzero_si256();
+
+					for (int p = 0; p < pairs; p++) {
+						std::int32_t pair;
+						std::memcpy(&pair, x + 2 * p, sizeof(pair));
+						__m256i wv = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + p * padded * 2)));
+						acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_set1_epi32(pair), wv));
+					}
+
+					__m256 y = _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc), _mm256_loadu_ps(l.scales.data() + j), _mm256_loadu_ps(l.bias.data() + j));
+					if (l.activation == ACTIVATION_RELU) {
+						y = _mm256_max_ps(y, zero);
+					}
+					else if (l.activation == ACTIVATION_LEAKY_RELU) {
+						y = _mm256_blendv_ps(_mm256_mul_ps(y, alpha), y, _mm256_cmp_ps(y, zero, _CMP_GT_OQ));
+					}
+
+					if (l.output_scale > 0.f) {
+						// Round, saturate and narrow the 8 channels to int8
+						__m256i v = _mm256_cvtps_epi32(_mm256_mul_ps(y, inv_scale));
+						v = _mm256_max_epi32(_mm256_min_epi32(v, max_value), min_value);
+						__m128i v16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+						__m128i v8 = _mm_packs_epi16(v16, v16);
+
+						std::int8_t * y8 = out + t * l.out_channels;
+						if (j + SIMD_WIDTH <= l.out_channels) {
+							_mm_storel_epi64(reinterpret_cast<__m128i*>(y8 + j), v8);
+						}
+						else {
+							std::int8_t tmp[16];
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(tmp), v8);
+							std::memcpy(y8 + j, tmp, l.out_channels - j);
+						}
+					}
+					else {
+						float tmp[SIMD_WIDTH];
+						_mm256_storeu_ps(tmp, y);
+						for (int c = j; c < l.out_channels && c < j + SIMD_WIDTH; c++) {
+							out_float[t * l.out_channels + c] = activate(tmp[c - j], l.activation == ACTIVATION_SIGMOID ? ACTIVATION_SIGMOID : ACTIVATION_LINEAR, 0.f);
+						}
+					}
+				}
+			}
+		}
+
+		CNN_TARGET_AVX2 void quantize_input_avx2 (const float * in, std::size_t n, float inv_scale, std::int8_t * out) {
+			const __m256 scale = _mm256_set1_ps(inv_scale);
+			const __m256i max_value = _mm256_set1_epi32(INT8_MAX_VALUE);
+			const __m256i min_value = _mm256_set1_epi32(-INT8_MAX_VALUE);
+
+			std::size_t i = 0;
+			for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+				__m256i v = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale));
+				v = _mm256_max_epi32(_mm256_min_epi32(v, max_value), min_value);
+				__m128i v16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(v16, v16));
+			}
+			for (; i < n; i++) {
+				out[i] = quantize_value(in[i], inv_scale);
+			}
+		}
+#endif
+
+		void conv_quantized (const quantized_model& q, const quantized_layer& l, const std::int16_t * in, std::size_t out_steps, std::int8_t * out, float * out_float) {
+#ifdef CNN_FUNCTIONS_X86
+			if (q.use_simd) {
+				conv_quantized_avx2(l, in, out_steps, out, out_float);
+				return;
+			}
+#endif
+			conv_quantized_scalar(l, in, out_steps, out, out_float);
+		}
+
+		void conv (const model& m, const layer& l, const float * in, std::size_t out_steps, float * out) {
+#ifdef CNN_FUNCTIONS_X86
+			if (m.use_simd) {
+				conv_avx2(l, in, out_steps, out);
+				return;
+			}
+#endif
+			conv_scalar(l, in, out_steps, out);
+		}
+	}
+
+
+	bool cpu_supports_simd () {
+#if defined(CNN_FUNCTIONS_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		__cpuid(info, 1);
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(CNN_FUNCTIONS_X86)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+		return false;
+#endif
+	}
+
+	int load_model (const char * model_path, model * m) {
+		std::string path(model_path);
+		std::string saved_model;
+		std::vector<std::string> keras_layers;
+
+		if (!read_file(path + "/saved_model.pb", saved_model)) {
+			fprintf(stderr, "ERROR: Unable to read %s/saved_model.pb\n", model_path);
+			return -1;
+		}
+		if (!read_keras_layers(saved_model, keras_layers)) return -1;
+
+		bundle bnd;
+		if (read_bundle(path + "/variables/variables", bnd) != 0) return -1;
+
+		std::vector<layer> layers;
+		int weights_index = 0;
+
+		for (const std::string& keras_layer : keras_layers) {
+			std::string class_name = json_string(keras_layer, "class_name", "");
+			std::string config;
+			json_member(keras_layer, "config", config);
+
+			// Layers that do nothing at inference time
+			if (class_name == "InputLayer" || class_name == "Dropout") continue;
+
+			std::string name = "layer_with_weights-" + std::to_string(weights_index);
+
+			if (class_name == "Conv1D" || class_name == "Dense") {
+				layer l;
+				std::vector<float> kernel, bias;
+				std::vector<std::int64_t> shape;
+
+				if (json_number(config, "use_bias", 1) != 0 && read_variable(bnd, name + "/bias", bias, shape) != 0) return -1;
+				if (read_variable(bnd, name + "/kernel", kernel, shape) != 0) return -1;
+
+				if (class_name == "Conv1D") {
+					if (shape.size() != 3 || json_string(config, "padding", "valid") != "valid" || json_number(config, "dilation_rate", 1) != 1) {
+						fprintf(stderr, "ERROR: Only valid, non-dilated Conv1D layers are supported\n");
+						return -1;
+					}
+					l.kernel_size = int(shape[0]);
+					l.stride = int(json_number(config, "strides", 1));
+					l.in_channels = int(shape[1]);
+					l.out_channels = int(shape[2]);
+				}
+				else {
+					if (shape.size() != 2) {
+						fprintf(stderr, "ERROR: Invalid Dense kernel\n");
+						return -1;
+					}
+					l.in_channels = int(shape[0]);
+					l.out_channels = int(shape[1]);
+				}
+
+				if (!layers.empty() && layers.back().out_channels != l.in_channels) {
+					fprintf(stderr, "ERROR: Channel mismatch at %s\n", name.c_str());
+					return -1;
+				}
+				if (!parse_activation(json_string(config, "activation", "linear"), l.activation)) return -1;
+
+				set_weights(l, kernel, bias);
+				layers.push_back(l);
+				weights_index++;
+			}
+			else if (class_name == "BatchNormalization") {
+				if (layers.empty() || layers.back().activation != ACTIVATION_LINEAR) {
+					fprintf(stderr, "ERROR: BatchNormalization must follow a linear layer\n");
+					return -1;
+				}
+				if (fold_batch_norm(bnd, name, config, layers.back()) != 0) return -1;
+				weights_index++;
+			}
+			else if (class_name == "LeakyReLU" || class_name == "ReLU" || class_name == "Activation") {
+				if (layers.empty() || layers.back().activation != ACTIVATION_LINEAR) {
+					fprintf(stderr, "ERROR: Activation layer must follow a linear layer\n");
+					return -1;
+				}
+				if (class_name == "LeakyReLU") {
+					layers.back().activation = ACTIVATION_LEAKY_RELU;
+					layers.back().alpha = float(json_number(config, "alpha", 0.3));
+				}
+				else if (class_name == "ReLU") {
+					layers.back().activation = ACTIVATION_RELU;
+				}
+				else if (!parse_activation(json_string(config, "activation", "linear"), layers.back().activation)) {
+					return -1;
+				}
+			}
+			else {
+				fprintf(stderr, "ERROR: Unsupported layer %s\n", class_name.c_str());
+				return -1;
+			}
+		}
+
+		if (layers.empty()) {
+			fprintf(stderr, "ERROR: Model has no layers\n");
+			return -1;
+		}
+
+		m->layers = layers;
+		m->activations = std::vector<std::vector<float>>(layers.size());
+		m->use_simd = cpu_supports_simd();
+
+		fprintf(stdout, "Successfully loaded native model (%d layers, %s)\n", int(layers.size()), m->use_simd ? "AVX2" : "scalar");
+		return 0;
+	}
+
+	void fold_input_normalization (layer * l, const float * means, const float * stds) {
+		// Valid padding, so every tap of every output step sees a normalized sample
+		for (int c = 0; c < l->out_channels; c++) {
+			for (int k = 0; k < l->kernel_size; k++) {
+				for (int i = 0; i < l->in_channels; i++) {
+					float& w = l->weights[(k * l->in_channels + i) * l->out_channels_padded + c];
+					l->bias[c] -= w * means[i] / stds[i];
+					w /= stds[i];
+				}
+			}
+		}
+	}
+
+	std::size_t model_output_steps (const model& m, std::size_t num_steps) {
+		for (const layer& l : m.layers) {
+			if (num_steps < std::size_t(l.kernel_size)) return 0;
+			num_steps = (num_steps - l.kernel_size) / l.stride + 1;
+		}
+		return num_steps;
+	}
+
+	void reserve_model (model * m, std::size_t max_steps) {
+		m->activations.resize(m->layers.size());
+		for (std::size_t i = 0; i < m->layers.size(); i++) {
+			const layer& l = m->layers[i];
+			max_steps = (max_steps < std::size_t(l.kernel_size)) ? 0 : (max_steps - l.kernel_size) / l.stride + 1;
+			m->activations[i].resize(max_steps * l.out_channels);
+		}
+	}
+
+	int run_model (model * m, const float * input, std::size_t num_steps, float * output) {
+		const float * in = input;
+		std::size_t steps = num_steps;
+
+		for (std::size_t i = 0; i < m->layers.size(); i++) {
+			const layer& l = m->layers[i];
+			if (steps < std::size_t(l.kernel_size)) {
+				fprintf(stderr, "ERROR: Input too short for the model\n");
+				return -1;
+			}
+			std::size_t out_steps = (steps - l.kernel_size) / l.stride + 1;
+
+			float * out = output;
+			if (i + 1 < m->layers.size()) {
+				// Only grows when run with a longer input than reserved
+				if (m->activations[i].size() < out_steps * l.out_channels) m->activations[i].resize(out_steps * l.out_channels);
+				out = m->activations[i].data();
+			}
+
+			conv(*m, l, in, out_steps, out);
+
+			in = out;
+			steps = out_steps;
+		}
+
+		return 0;
+	}
+
+
+	int create_stream (const model& m, std::size_t window_steps, stream * s) {
+		if (model_output_steps(m, window_steps) == 0) {
+			fprintf(stderr, "ERROR: Stream window too short for the model\n");
+			return -1;
+		}
+
+		// Columns used by one window end inside it, so rings of twice the window never overwrite them
+		std::size_t capacity = 1;
+		while (capacity < 2 * window_steps) capacity <<= 1;
+
+		s->window_steps = window_steps;
+		s->levels.assign(m.layers.size() + 1, std::vector<float>());
+		s->tags.assign(m.layers.size() + 1, std::vector<std::int64_t>(capacity, -1));
+		s->masks.assign(m.layers.size() + 1, capacity - 1);
+
+		std::size_t max_gather = 0;
+		s->levels[0].assign(capacity * m.layers[0].in_channels, 0.f);
+		for (std::size_t i = 0; i < m.layers.size(); i++) {
+			const layer& l = m.layers[i];
+			s->levels[i + 1].assign(capacity * l.out_channels, 0.f);
+			max_gather = std::max(max_gather, std::size_t(l.kernel_size * l.in_channels));
+		}
+		s->gather.assign(max_gather, 0.f);
+
+		reset_stream(s);
+		return 0;
+	}
+
+	void reset_stream (stream * s) {
+		s->next_time = 0;
+		for (auto& level_tags : s->tags) {
+			std::fill(level_tags.begin(), level_tags.end(), -1);
+		}
+	}
+
+	void push_stream (const model& m, stream * s, const float * row) {
+		int channels = m.layers[0].in_channels;
+		std::size_t slot = std::size_t(s->next_time) & s->masks[0];
+
+		std::memcpy(&s->levels[0][slot * channels], row, channels * sizeof(float));
+		s->tags[0][slot] = s->next_time;
+		s->next_time++;
+	}
+
+	int run_stream (model * m, stream * s, float * output) {
+		if (s->next_time < std::int64_t(s->window_steps)) {
+			return -1;
+		}
+
+		// Window start, spacing of the layer input columns and time offset of its first input column
+		std::int64_t start = s->next_time - std::int64_t(s->window_steps);
+		std::int64_t spacing = 1, end_offset = 0;
+		std::size_t steps = s->window_steps;
+
+		for (std::size_t i = 0; i < m->layers.size(); i++) {
+			const layer& l = m->layers[i];
+			const std::vector<float>& in = s->levels[i];
+			std::vector<float>& out = s->levels[i + 1];
+			std::vector<std::int64_t>& out_tags = s->tags[i + 1];
+
+			std::size_t out_steps = (steps - l.kernel_size) / l.stride + 1;
+			std::int64_t out_spacing = spacing * l.stride;
+			std::int64_t out_end_offset = end_offset + (l.kernel_size - 1) * spacing;
+
+			for (std::size_t j = 0; j < out_steps; j++) {
+				std::int64_t time = start + std::int64_t(j) * out_spacing + out_end_offset;
+				std::size_t slot = std::size_t(time) & s->masks[i + 1];
+
+				// Already computed for a previous, overlapping window
+				if (out_tags[slot] == time) continue;
+
+				for (int k = 0; k < l.kernel_size; k++) {
+					std::int64_t in_time = time - std::int64_t(l.kernel_size - 1 - k) * spacing;
+					std::size_t in_slot = std::size_t(in_time) & s->masks[i];
+					std::memcpy(&s->gather[k * l.in_channels], &in[in_slot * l.in_channels], l.in_channels * sizeof(float));
+				}
+
+				conv(*m, l, s->gather.data(), 1, &out[slot * l.out_channels]);
+				out_tags[slot] = time;
+			}
+
+			spacing = out_spacing;
+			end_offset = out_end_offset;
+			steps = out_steps;
+		}
+
+		// Output columns of the last layer that belong to this window
+		const layer& last = m->layers.back();
+		for (std::size_t j = 0; j < steps; j++) {
+			std::int64_t time = start + std::int64_t(j) * spacing + end_offset;
+			std::size_t slot = std::size_t(time) & s->masks.back();
+			std::memcpy(output + j * last.out_channels, &s->levels.back()[slot * last.out_channels], last.out_channels * sizeof(float));
+		}
+
+		return 0;
+	}
+
+
+	int quantize_model (model * m, const float * inputs, std::size_t num_windows, std::size_t window_steps, quantized_model * q) {
+		std::size_t output_steps = model_output_steps(*m, window_steps);
+		if (num_windows == 0 || output_steps == 0) {
+			fprintf(stderr, "ERROR: No calibration windows for quantization\n");
+			return -1;
+		}
+
+		// Activation ranges seen by the float model: [0] is the input, [i + 1] the output of layer i
+		std::size_t num_layers = m->layers.size();
+		std::size_t window_size = window_steps * m->layers[0].in_channels;
+		std::vector<float> ranges(num_layers + 1, 0.f);
+		std::vector<float> output(output_steps * m->layers.back().out_channels);
+
+		for (std::size_t w = 0; w < num_windows; w++) {
+			const float * window = inputs + w * window_size;
+			if (run_model(m, window, window_steps, output.data()) != 0) return -1;
+
+			ranges[0] = std::max(ranges[0], max_abs(window, window_size));
+			std::size_t steps = window_steps;
+			for (std::size_t i = 0; i + 1 < num_layers; i++) {
+				const layer& l = m->layers[i];
+				steps = (steps - l.kernel_size) / l.stride + 1;
+				ranges[i + 1] = std::max(ranges[i + 1], max_abs(m->activations[i].data(), steps * l.out_channels));
+			}
+		}
+
+		q->layers.assign(num_layers, quantized_layer());
+		q->input_scale = scale_for(ranges[0]);
+		q->use_simd = m->use_simd;
+
+		for (std::size_t i = 0; i < num_layers; i++) {
+			const layer& l = m->layers[i];
+			quantized_layer& ql = q->layers[i];
+			float input_scale = scale_for(ranges[i]);
+			int taps = l.kernel_size * l.in_channels;
+
+			ql.kernel_size = l.kernel_size;
+			ql.stride = l.stride;
+			ql.in_channels = l.in_channels;
+			ql.out_channels = l.out_channels;
+			ql.out_channels_padded = l.out_channels_padded;
+			ql.taps_padded = taps + (taps & 1);
+			ql.activation = l.activation;
+			ql.alpha = l.alpha;
+			ql.output_scale = (i + 1 < num_layers) ? scale_for(ranges[i + 1]) : 0.f;
+			ql.output_inv_scale = (ql.output_scale > 0.f) ? 1.f / ql.output_scale : 0.f;
+			ql.bias = l.bias;
+			ql.scales.assign(l.out_channels_padded, 0.f);
+			ql.weights.assign(std::size_t(ql.taps_padded) * l.out_channels_padded, 0);
+
+			// Symmetric per output channel weight scales
+			for (int c = 0; c < l.out_channels; c++) {
+				float w_max = 0.f;
+				for (int r = 0; r < taps; r++) w_max = std::max(w_max, std::fabs(l.weights[r * l.out_channels_padded + c]));
+
+				float w_scale = scale_for(w_max);
+				ql.scales[c] = input_scale * w_scale;
+				for (int r = 0; r < taps; r++) {
+					ql.weights[((r >> 1) * l.out_channels_padded + c) * 2 + (r & 1)] = quantize_value(l.weights[r * l.out_channels_padded + c], 1.f / w_scale);
+				}
+			}
+		}
+
+		// Scratch sized for the calibration windows, the usual input length
+		q->input.assign(window_size, 0);
+		q->widened.assign(window_size + 1, 0);
+		q->activations.assign(num_layers, std::vector<std::int8_t>());
+		std::size_t steps = window_steps;
+		for (std::size_t i = 0; i < num_layers; i++) {
+			steps = (steps - q->layers[i].kernel_size) / q->layers[i].stride + 1;
+			q->activations[i].assign(steps * q->layers[i].out_channels, 0);
+		}
+
+		fprintf(stdout, "Quantized native model to INT8 with %d calibration windows\n", int(num_windows));
+		return 0;
+	}
+
+	int run_quantized (quantized_model * q, const float * input, std::size_t num_steps, float * output) {
+		if (q->layers.empty()) {
+			fprintf(stderr, "ERROR: Model not quantized\n");
+			return -1;
+		}
+
+		std::size_t input_size = num_steps * q->layers[0].in_channels;
+		if (q->input.size() < input_size) q->input.resize(input_size, 0);
+
+		float inv_scale = 1.f / q->input_scale;
+#ifdef CNN_FUNCTIONS_X86
+		if (q->use_simd) {
+			quantize_input_avx2(input, input_size, inv_scale, q->input.data());
+		}
+		else
+#endif
+		{
+			for (std::size_t i = 0; i < input_size; i++) {
+				q->input[i] = quantize_value(input[i], inv_scale);
+			}
+		}
+
+		const std::int8_t * in = q->input.data();
+		std::size_t steps = num_steps;
+
+		for (std::size_t i = 0; i < q->layers.size(); i++) {
+			const quantized_layer& l = q->layers[i];
+			if (steps < std::size_t(l.kernel_size)) {
+				fprintf(stderr, "ERROR: Input too short for the model\n");
+				return -1;
+			}
+			std::size_t out_steps = (steps - l.kernel_size) / l.stride + 1;
+
+			std::vector<std::int8_t>& out = q->activations[i];
+			if (out.size() < out_steps * l.out_channels) out.resize(out_steps * l.out_channels, 0);
+
+			std::size_t in_size = steps * l.in_channels;
+			if (q->widened.size() < in_size + 1) q->widened.resize(in_size + 1, 0);
+			for (std::size_t j = 0; j < in_size; j++) {
+				q->widened[j] = in[j];
+			}
+
+			conv_quantized(*q, l, q->widened.data(), out_steps, out.data(), output);
+
+			in = out.data();
+			steps = out_steps;
+		}
+
+		return 0;
+	}
+
+	int compare_quantized (model * m, quantized_model * q, const float * inputs, std::size_t num_windows, std::size_t window_steps,
+		float threshold, quantization_report * report) {
+		std::size_t output_size = model_output_steps(*m, window_steps) * m->layers.back().out_channels;
+		if (output_size == 0) return -1;
+
+		std::size_t window_size = window_steps * m->layers[0].in_channels;
+		std::vector<float> float_output(output_size), quantized_output(output_size);
+		*report = quantization_report();
+
+		double error_sum = 0.;
+		for (std::size_t w = 0; w < num_windows; w++) {
+			const float * window = inputs + w * window_size;
+			if (run_model(m, window, window_steps, float_output.data()) != 0 ||
+				run_quantized(q, window, window_steps, quantized_output.data()) != 0) return -1;
+
+			bool float_detection = float_output[0] >= threshold;
+			bool quantized_detection = quantized_output[0] >= threshold;
+			report->float_detections += float_detection;
+			report->quantized_detections += quantized_detection;
+			report->common_detections += (float_detection && quantized_detection);
+
+			float error = std::fabs(float_output[0] - quantized_output[0]);
+			report->max_error = std::max(report->max_error, error);
+			error_sum += error;
+		}
+
+		report->windows = num_windows;
+		report->mean_error = num_windows ? float(error_sum / num_windows) : 0.f;
+		return 0;
+	}
+}
@@ -0,0 +1,137 @@
+#ifndef CNN_FUNCTIONS_H_DEFINED
+#define CNN_FUNCTIONS_H_DEFINED
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Native (TensorFlow-free) forward pass for the 1D CNN-ripple network.
+// Weights are read from the SavedModel checkpoint (variables/variables.index + data shards)
+// and the layer hyperparameters from the Keras metadata stored in saved_model.pb.
+namespace cnn_functions {
+
+	enum activation_type {
+		ACTIVATION_LINEAR = 0,
+		ACTIVATION_RELU,
+		ACTIVATION_LEAKY_RELU,
+		ACTIVATION_SIGMOID
+	};
+
+	// Conv1D (valid padding) with the following BatchNormalization folded into its weights.
+	// Dense layers are stored as kernel_size = stride = 1 convolutions applied on every time step.
+	struct layer {
+		int kernel_size = 1;
+		int stride = 1;
+		int in_channels = 0;
+		int out_channels = 0;
+		int out_channels_padded = 0; // Multiple of 8 so SIMD kernels never need a tail loop
+
+		std::vector<float> weights; // [kernel_size * in_channels][out_channels_padded]
+		std::vector<float> bias;    // [out_channels_padded]
+
+		activation_type activation = ACTIVATION_LINEAR;
+		float alpha = 0.f;
+	};
+
+	struct model {
+		std::vector<layer> layers;
+		bool use_simd = false;
+
+		// Scratch activations, one per layer, reused by every run
+		std::vector<std::vector<float>> activations;
+	};
+
+	int load_model (const char * model_path, model * m);
+
+	// Folds the z-score (x - means[i]) / stds[i] of the input channels into a first layer, so it takes raw samples
+	void fold_input_normalization (layer * l, const float * means, const float * stds);
+
+	// Allocates the scratch activations for inputs of up to max_steps time steps
+	void reserve_model (model * m, std::size_t max_steps);
+
+	// Number of outputs per channel produced for an input of num_steps time steps
+	std::size_t model_output_steps (const model& m, std::size_t num_steps);
+
+	// input is [num_steps][in_channels] row-major, output receives [output_steps][out_channels]
+	int run_model (model * m, const float * input, std::size_t num_steps, float * output);
+
+	bool cpu_supports_simd ();
+
+
+	// Streaming inference over a sliding window. Every layer keeps a ring of output columns tagged with the
+	// input time they end at, so consecutive (overlapping) windows only compute the columns they do not share.
+	struct stream {
+		std::size_t window_steps = 0;
+		std::int64_t next_time = 0; // Input time of the next pushed row
+
+		// levels[0] holds the input rows, levels[l + 1] the output columns of layer l
+		std::vector<std::vector<float>> levels;
+		std::vector<std::vector<std::int64_t>> tags;
+		std::vector<std::size_t> masks;
+		std::vector<float> gather; // Input columns of the column being computed
+	};
+
+	int create_stream (const model& m, std::size_t window_steps, stream * s);
+
+	// Drops all cached rows and columns
+	void reset_stream (stream * s);
+
+	// Appends one input time step ([in_channels] values)
+	void push_stream (const model& m, stream * s, const float * row);
+
+	// Runs the model on the last window_steps pushed rows, output as in run_model
+	int run_stream (model * m, stream * s, float * output);
+
+
+	// INT8 inference: int8 weights with one scale per output channel, int8 activations with one scale per layer
+	// and int32 accumulation. Activation scales are calibrated by running the float model on recorded windows.
+	struct quantized_layer {
+		int kernel_size = 1;
+		int stride = 1;
+		int in_channels = 0;
+		int out_channels = 0;
+		int out_channels_padded = 0;
+		int taps_padded = 0; // kernel_size * in_channels rounded up to even, the SIMD kernel reads inputs in pairs
+
+		std::vector<std::int8_t> weights; // [taps_padded / 2][out_channels_padded][2]
+		std::vector<float> scales;        // [out_channels_padded] input scale * weight scale
+		std::vector<float> bias;          // [out_channels_padded]
+
+		activation_type activation = ACTIVATION_LINEAR;
+		float alpha = 0.f;
+		float output_scale = 0.f; // Scale of the int8 outputs, 0 for the last layer which outputs floats
+		float output_inv_scale = 0.f;
+	};
+
+	struct quantized_model {
+		std::vector<quantized_layer> layers;
+		float input_scale = 1.f;
+		bool use_simd = false;
+
+		// Quantized input and scratch activations
+		std::vector<std::int8_t> input;
+		std::vector<std::vector<std::int8_t>> activations;
+		std::vector<std::int16_t> widened; // Layer input widened for the kernels, one spare value for odd tap counts
+	};
+
+	// inputs holds num_windows consecutive [window_steps][in_channels] windows
+	int quantize_model (model * m, const float * inputs, std::size_t num_windows, std::size_t window_steps, quantized_model * q);
+
+	// Same input and output layout as run_model
+	int run_quantized (quantized_model * q, const float * input, std::size_t num_steps, float * output);
+
+	// Detections (first output >= threshold) of both models on the same windows
+	struct quantization_report {
+		std::size_t windows = 0;
+		std::size_t float_detections = 0;
+		std::size_t quantized_detections = 0;
+		std::size_t common_detections = 0;
+		float max_error = 0.f; // Largest absolute difference between the float and INT8 probabilities
+		float mean_error = 0.f;
+	};
+
+	int compare_quantized (model * m, quantized_model * q, const float * inputs, std::size_t num_windows, std::size_t window_steps,
+		float threshold, quantization_report * report);
+}
+
+#endif
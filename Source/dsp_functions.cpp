@@ -0,0 +1,289 @@
+#include "dsp_functions.hpp"
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DSP_FUNCTIONS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define DSP_TARGET_AVX2
+#else
+#define DSP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+#define SIMD_WIDTH 8
+#define RESAMPLER_BLOCK 256  // Input samples transposed into the history at a time
+#define RESAMPLER_CUTOFF 0.8 // Cutoff as a fraction of the output Nyquist frequency
+#define RESAMPLER_PHASES 64  // Sub-filters for fractional ratios, output times are rounded down to 1/64 of an input sample
+
+
+namespace dsp_functions {
+
+	namespace {
+
+		const double PI = 3.14159265358979323846;
+		const double FIXED_ONE = 4294967296.; // 1 in 32.32 fixed point
+
+		int pad_channels (int channels) {
+			return (channels + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+		}
+
+		// Hamming windowed sinc with unit DC gain, for an output delay samples after the newest input
+		void design_lowpass (int num_taps, double cutoff, double delay, float * taps) {
+			std::vector<double> h(num_taps);
+			double sum = 0.;
+			double center = (num_taps - 1) / 2.;
+
+			for (int k = 0; k < num_taps; k++) {
+				// Distance from the output time to the input multiplied by this tap
+				double t = delay + (num_taps - 1 - k);
+				double x = t - center;
+				double sinc = (x == 0.) ? 2. * cutoff : std::sin(2. * PI * cutoff * x) / (PI * x);
+				double window = (t <= num_taps - 1) ? 0.54 - 0.46 * std::cos(2. * PI * t / (num_taps - 1)) : 0.;
+				h[k] = sinc * window;
+				sum += h[k];
+			}
+
+			for (int k = 0; k < num_taps; k++) {
+				taps[k] = float(h[k] / sum);
+			}
+		}
+
+		// Planar input to padded rows, the padding channels stay at zero
+		void transpose_block (const float * const * input, std::size_t offset, std::size_t num_samples, int channels, int padded, float * rows) {
+			for (int c = 0; c < channels; c++) {
+				const float * x = input[c] + offset;
+				for (std::size_t i = 0; i < num_samples; i++) {
+					rows[i * padded + c] = x[i];
+				}
+			}
+		}
+
+		void filter_scalar (const resampler& r, const float * taps, const float * rows, float * out) {
+			for (int c = 0; c < r.channels; c++) {
+				float acc = 0.f;
+				for (int k = 0; k < r.num_taps; k++) {
+					acc += taps[k] * rows[k * r.channels_padded + c];
+				}
+				out[c] = acc;
+			}
+		}
+
+#ifdef DSP_FUNCTIONS_X86
+		// Each tap is broadcast and FMA'd into 8 channels at once, two accumulators hide the FMA latency
+		DSP_TARGET_AVX2 void filter_avx2 (const resampler& r, const float * taps, const float * rows, float * out) {
+			const int padded = r.channels_padded;
+
+			for (int j = 0; j < padded; j += SIMD_WIDTH) {
+				const float * x = rows + j;
+				__m256 acc0 = _mm256_setzero_ps();
+				__m256 acc1 = _mm256_setzero_ps();
+
+				int k = 0;
+				for (; k + 1 < r.num_taps; k += 2) {
+					acc0 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k]), _mm256_loadu_ps(x + k * padded), acc0);
+					acc1 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k + 1]), _mm256_loadu_ps(x + (k + 1) * padded), acc1);
+				}
+				if (k < r.num_taps) {
+					acc0 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k]), _mm256_loadu_ps(x + k * padded), acc0);
+				}
+				acc0 = _mm256_add_ps(acc0, acc1);
+
+				if (j + SIMD_WIDTH <= r.channels) {
+					_mm256_storeu_ps(out + j, acc0);
+				}
+				else {
+					float tail[SIMD_WIDTH];
+					_mm256_storeu_ps(tail, acc0);
+					for (int c = j; c < r.channels; c++) {
+						out[c] = tail[c - j];
+					}
+				}
+			}
+		}
+#endif
+
+		void filter (const resampler& r, const float * taps, const float * rows, float * out) {
+#ifdef DSP_FUNCTIONS_X86
+			if (r.use_simd) {
+				filter_avx2(r, taps, rows, out);
+				return;
+			}
+#endif
+			filter_scalar(r, taps, rows, out);
+		}
+
+		// RBJ cookbook biquad with Q = 1/sqrt(2), normalized by a0
+		void design_biquad (bool high_pass, double cutoff, double rate, double q, float * coefs) {
+			double w0 = 2. * PI * cutoff / rate;
+			double cos_w0 = std::cos(w0);
+			double alpha = std::sin(w0) / (2. * q);
+			double a0 = 1. + alpha;
+			double b1 = high_pass ? -(1. + cos_w0) : 1. - cos_w0;
+
+			coefs[0] = float(std::abs(b1) / 2. / a0);
+			coefs[1] = float(b1 / a0);
+			coefs[2] = coefs[0];
+			coefs[3] = float(-2. * cos_w0 / a0);
+			coefs[4] = float((1. - alpha) / a0);
+		}
+
+		float band_row_scalar (band_filter * f, const float * x) {
+			float sum = 0.f;
+			for (int c = 0; c < f->channels; c++) {
+				float y = x[c];
+				for (int s = 0; s < f->num_sections; s++) {
+					const float * k = f->coefs.data() + s * 5;
+					float * z1 = f->state.data() + (s * 2) * f->channels_padded;
+					float * z2 = z1 + f->channels_padded;
+					float in = y;
+					y = k[0] * in + z1[c];
+					z1[c] = k[1] * in - k[3] * y + z2[c];
+					z2[c] = k[2] * in - k[4] * y;
+				}
+				sum += y * y;
+			}
+			return sum / f->channels;
+		}
+
+#ifdef DSP_FUNCTIONS_X86
+		DSP_TARGET_AVX2 float band_row_avx2 (band_filter * f, const float * x) {
+			const int padded = f->channels_padded;
+			__m256 sum = _mm256_setzero_ps();
+
+			for (int j = 0; j < padded; j += SIMD_WIDTH) {
+				__m256 y = _mm256_loadu_ps(x + j);
+				for (int s = 0; s < f->num_sections; s++) {
+					const float * k = f->coefs.data() + s * 5;
+					float * z1 = f->state.data() + (s * 2) * padded + j;
+					float * z2 = z1 + padded;
+					__m256 in = y;
+					y = _mm256_fmadd_ps(_mm256_set1_ps(k[0]), in, _mm256_loadu_ps(z1));
+					__m256 next1 = _mm256_fnmadd_ps(_mm256_set1_ps(k[3]), y, _mm256_fmadd_ps(_mm256_set1_ps(k[1]), in, _mm256_loadu_ps(z2)));
+					__m256 next2 = _mm256_fnmadd_ps(_mm256_set1_ps(k[4]), y, _mm256_mul_ps(_mm256_set1_ps(k[2]), in));
+					_mm256_storeu_ps(z1, next1);
+					_mm256_storeu_ps(z2, next2);
+				}
+				sum = _mm256_fmadd_ps(y, y, sum);
+			}
+
+			// The padding channels filter zeros, so they add nothing
+			float lanes[SIMD_WIDTH];
+			_mm256_storeu_ps(lanes, sum);
+			float total = 0.f;
+			for (int i = 0; i < SIMD_WIDTH; i++) total += lanes[i];
+			return total / f->channels;
+		}
+#endif
+	}
+
+
+	int create_resampler (double factor, int taps_per_output, int channels, resampler * r) {
+		if (factor < 1. || taps_per_output < 0 || channels < 1) {
+			fprintf(stderr, "Invalid resampler: factor %f, %d taps per output, %d channels\n", factor, taps_per_output, channels);
+			return -1;
+		}
+
+		r->factor = factor;
+		r->step = std::uint64_t(std::llround(factor * FIXED_ONE));
+		r->channels = channels;
+		r->channels_padded = pad_channels(channels);
+		r->num_taps = (taps_per_output > 0) ? int(std::ceil(factor * taps_per_output)) : 1;
+
+		// Integer ratios always land on an input sample, so they need a single sub-filter
+		bool fractional = (r->step & 0xffffffffull) != 0;
+		r->num_phases = (r->num_taps > 1 && fractional) ? RESAMPLER_PHASES : 1;
+
+		r->taps.assign(std::size_t(r->num_phases) * r->num_taps, 1.f);
+		if (r->num_taps > 1) {
+			for (int p = 0; p < r->num_phases; p++) {
+				design_lowpass(r->num_taps, RESAMPLER_CUTOFF * 0.5 / factor, double(p) / r->num_phases, r->taps.data() + p * r->num_taps);
+			}
+		}
+
+		r->history.assign(std::size_t(r->num_taps - 1 + RESAMPLER_BLOCK) * r->channels_padded, 0.f);
+		reset_resampler(r);
+		return 0;
+	}
+
+	void reset_resampler (resampler * r) {
+		std::fill(r->history.begin(), r->history.end(), 0.f);
+		r->position = 0;
+	}
+
+	double resampler_delay (const resampler& r) {
+		// Every sub-filter is centered on the same input time, (num_taps - 1) / 2 samples before the newest input
+		return (r.num_taps - 1) / 2.;
+	}
+
+	std::size_t run_resampler (resampler * r, const float * const * input, std::size_t num_samples, float * output, std::size_t * samples) {
+		const std::size_t keep = r->num_taps - 1;
+		const int padded = r->channels_padded;
+		std::size_t num_rows = 0;
+
+		for (std::size_t offset = 0; offset < num_samples; offset += RESAMPLER_BLOCK) {
+			std::size_t block = std::min<std::size_t>(RESAMPLER_BLOCK, num_samples - offset);
+			float * rows = r->history.data();
+
+			// Row keep + i of the history is sample offset + i, so the filter of an output ending there starts at row i
+			transpose_block(input, offset, block, r->channels, padded, rows + keep * padded);
+
+			for (; (r->position >> 32) < block; r->position += r->step) {
+				std::size_t i = std::size_t(r->position >> 32);
+				std::size_t phase = ((r->position & 0xffffffffull) * r->num_phases) >> 32;
+
+				filter(*r, r->taps.data() + phase * r->num_taps, rows + i * padded, output + num_rows * r->channels);
+				samples[num_rows] = offset + i;
+				num_rows++;
+			}
+			r->position -= std::uint64_t(block) << 32;
+
+			std::copy(rows + block * padded, rows + (block + keep) * padded, rows);
+		}
+
+		return num_rows;
+	}
+
+	int create_band_filter (double low, double high, double rate, int order, int channels, band_filter * f) {
+		if (low <= 0. || high <= low || high >= rate / 2. || order < 2 || order % 2 != 0 || channels < 1) {
+			fprintf(stderr, "Invalid band filter: %f-%f Hz at %f Hz, order %d, %d channels\n", low, high, rate, order, channels);
+			return -1;
+		}
+
+		f->num_sections = order;
+		f->channels = channels;
+		f->channels_padded = pad_channels(channels);
+		f->coefs.assign(std::size_t(f->num_sections) * 5, 0.f);
+		for (int s = 0; s < f->num_sections; s++) {
+			bool high_pass = s < order / 2;
+			// Butterworth pole pair k of the edge, 1 / sqrt(2) for a single section
+			int k = s % (order / 2);
+			double q = 1. / (2. * std::sin((2 * k + 1) * PI / (2. * order)));
+			design_biquad(high_pass, high_pass ? low : high, rate, q, f->coefs.data() + s * 5);
+		}
+
+		f->state.assign(std::size_t(f->num_sections) * 2 * f->channels_padded, 0.f);
+		f->row.assign(f->channels_padded, 0.f);
+		return 0;
+	}
+
+	void reset_band_filter (band_filter * f) {
+		std::fill(f->state.begin(), f->state.end(), 0.f);
+	}
+
+	void run_band_filter (band_filter * f, const float * rows, std::size_t num_rows, float * power) {
+		for (std::size_t r = 0; r < num_rows; r++) {
+			const float * x = rows + r * f->channels;
+#ifdef DSP_FUNCTIONS_X86
+			if (f->use_simd) {
+				std::copy(x, x + f->channels, f->row.begin());
+				power[r] = band_row_avx2(f, f->row.data());
+				continue;
+			}
+#endif
+			power[r] = band_row_scalar(f, x);
+		}
+	}
+}
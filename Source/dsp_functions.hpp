@@ -0,0 +1,68 @@
+#ifndef DSP_FUNCTIONS_H_DEFINED
+#define DSP_FUNCTIONS_H_DEFINED
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Signal conditioning between the acquisition buffers and the model input rows.
+// Inputs are planar (one pointer per channel, as in AudioSampleBuffer), outputs are [rows][channels] row-major.
+namespace dsp_functions {
+
+	// Low-pass FIR resampler to a lower rate, for any ratio. Outputs fall every factor input samples, factor need not be
+	// an integer. Each output is computed only where it falls, with the sub-filter of a precomputed polyphase bank
+	// for its fractional position, so the cost per output is num_taps multiply-adds whatever the ratio.
+	// Vectorized across channels, so a tap costs one multiply-add for 8 channels.
+	struct resampler {
+		double factor = 1.;      // Input samples per output
+		std::uint64_t step = 0;  // factor in 32.32 fixed point, so the output times do not drift
+		int num_taps = 1;
+		int num_phases = 1;
+		int channels = 0;
+		int channels_padded = 0; // Multiple of 8 so SIMD kernels never need a tail loop
+		bool use_simd = false;
+
+		std::vector<float> taps;    // [num_phases][num_taps], taps[p][0] multiplies the oldest sample. Phase p is for outputs
+		                            // p / num_phases input samples after the newest one they use
+		std::vector<float> history; // [num_taps - 1 + block][channels_padded] input rows, the last num_taps - 1 are kept between calls
+		std::uint64_t position = 0; // Time of the next output from the start of the next input, 32.32 fixed point
+	};
+
+	// taps_per_output = 0 takes the last input sample at each output time, without filtering
+	int create_resampler (double factor, int taps_per_output, int channels, resampler * r);
+
+	// Clears the filter state, the next input sample gives an output
+	void reset_resampler (resampler * r);
+
+	// Group delay in input samples
+	double resampler_delay (const resampler& r);
+
+	// Filters num_samples samples of every channel. output receives one row per output time in the input, and
+	// samples the index of the input sample each row ends at (the newest sample it uses). Returns the number of rows,
+	// at most num_samples / factor + 1
+	std::size_t run_resampler (resampler * r, const float * const * input, std::size_t num_samples, float * output, std::size_t * samples);
+
+	// Band-pass of every channel of [rows][channels] input, as a Butterworth high-pass at the low edge followed by a
+	// Butterworth low-pass at the high edge, each a cascade of biquads with the Q of its pole pair. The state of a section is kept for 8 channels per vector,
+	// so a row costs one vector update per section and 8 channels.
+	struct band_filter {
+		int num_sections = 0;
+		int channels = 0;
+		int channels_padded = 0;
+		bool use_simd = false;
+
+		std::vector<float> coefs; // [num_sections][5] b0 b1 b2 a1 a2, normalized by a0
+		std::vector<float> state; // [num_sections][2][channels_padded], transposed direct form II
+		std::vector<float> row;   // [channels_padded] input row, the padding channels stay at zero
+	};
+
+	// order is the order of each edge, even, with order / 2 biquads per edge. low and high in Hz
+	int create_band_filter (double low, double high, double rate, int order, int channels, band_filter * f);
+
+	void reset_band_filter (band_filter * f);
+
+	// Filters num_rows rows and writes the mean square of the filtered channels of each row to power
+	void run_band_filter (band_filter * f, const float * rows, std::size_t num_rows, float * power);
+}
+
+#endif
@@ -3,11 +3,50 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 
 namespace tf_functions {
 
+	namespace {
+		void encode_varint (std::vector<std::uint8_t>& buf, std::uint64_t value) {
+			while (value >= 0x80) {
+				buf.push_back(static_cast<std::uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			buf.push_back(static_cast<std::uint8_t>(value));
+		}
+
+		void encode_field (std::vector<std::uint8_t>& buf, int field, std::uint64_t value) {
+			encode_varint(buf, (std::uint64_t(field) << 3) | 0); // Varint wire type
+			encode_varint(buf, value);
+		}
+	}
+
+	std::vector<std::uint8_t> encode_config (const session_options& options) {
+		std::vector<std::uint8_t> buf;
+
+		// device_count (1): map<string, int32> entry {key (1): "CPU", value (2): count}
+		std::vector<std::uint8_t> entry = { 0x0a, 0x03, 'C', 'P', 'U' };
+		encode_field(entry, 2, options.device_count);
+		encode_varint(buf, (1 << 3) | 2); // Length-delimited wire type
+		encode_varint(buf, entry.size());
+		buf.insert(buf.end(), entry.begin(), entry.end());
+
+		encode_field(buf, 2, options.intra_op_threads);        // intra_op_parallelism_threads
+		encode_field(buf, 5, options.inter_op_threads);        // inter_op_parallelism_threads
+		encode_field(buf, 9, options.use_per_session_threads); // use_per_session_threads
+
+		return buf;
+	}
+
 	int load_session (const char * model_path, TF_Graph ** graph, TF_Session ** session) {
+		return load_session(model_path, graph, session, session_options());
+	}
+
+	int load_session (const char * model_path, TF_Graph ** graph, TF_Session ** session, const session_options& options) {
 		TF_Status * status = TF_NewStatus();
 		TF_SessionOptions * session_opts = TF_NewSessionOptions();
 		TF_Buffer * run_opts = NULL;
@@ -15,12 +54,14 @@ namespace tf_functions {
 		int num_tags = 1;
 
 
-		// Initialize the number of worker threads to 1
-		uint8_t intra_op_parallelism_threads = 1;
-	    uint8_t inter_op_parallelism_threads = 1;
-	    uint8_t device_count = 1; //device_count limits the number of CPUs
-		uint8_t buf[15] = {0xa, 0x7, 0xa, 0x3, 0x43, 0x50, 0x55, 0x10, device_count, 0x10, intra_op_parallelism_threads, 0x28, intra_op_parallelism_threads,0x40, 0x1};
-	    TF_SetConfig(session_opts, buf,sizeof(buf),status);
+		std::vector<std::uint8_t> config = encode_config(options);
+	    TF_SetConfig(session_opts, config.data(), config.size(), status);
+		if (TF_GetCode(status) != TF_OK) {
+			fprintf(stderr, "ERROR: Unable to set session options %s\n", TF_Message(status));
+			TF_DeleteSessionOptions(session_opts);
+			TF_DeleteStatus(status);
+			return -1;
+		}
 
 		*graph = TF_NewGraph();
 
@@ -31,18 +72,112 @@ namespace tf_functions {
 	    if (TF_GetCode(status) != TF_OK) {
 			fprintf(stderr, "ERROR: Unable to create session %s\n", TF_Message(status));
 			TF_DeleteStatus(status);
+			TF_DeleteGraph(*graph);
+			*graph = nullptr;
+			*session = nullptr;
 			return -1;
 		}
 	    TF_DeleteStatus(status);
 
-	    fprintf(stdout, "Successfully created session\n");
+	    fprintf(stdout, "Successfully created session (intra %d, inter %d, per session threads %d)\n",
+			options.intra_op_threads, options.inter_op_threads, int(options.use_per_session_threads));
 	    return 0;
 	}
 
+	int tune_session (const char * model_path, const char * input_name, const char * output_name,
+		const std::int64_t * dims, std::size_t num_dims, int num_runs, session_options * best) {
+
+		int hardware_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+		std::vector<session_options> candidates;
+		for (int intra : { 1, 2, 4 }) {
+			for (int inter : { 1, 2 }) {
+				for (bool per_session : { false, true }) {
+					if (intra > hardware_threads || inter > hardware_threads) continue;
+
+					session_options candidate = *best;
+					candidate.intra_op_threads = intra;
+					candidate.inter_op_threads = inter;
+					candidate.use_per_session_threads = per_session;
+					candidates.push_back(candidate);
+				}
+			}
+		}
+
+		double best_time = -1;
+		for (const session_options& candidate : candidates) {
+			TF_Graph * graph = nullptr;
+			TF_Session * session = nullptr;
+			if (load_session(model_path, &graph, &session, candidate) != 0) continue;
+
+			TF_Output input = { TF_GraphOperationByName(graph, input_name), 0 };
+			TF_Output output = { TF_GraphOperationByName(graph, output_name), 0 };
+			tensor_pool pool;
+
+			if (input.oper != nullptr && output.oper != nullptr && create_tensor_pool(TF_FLOAT, dims, num_dims, &pool) == 0) {
+				// The first runs pay for lazy initialization, only the following ones are timed
+				for (int i = 0; i < 3; i++) run_session(session, &input, &output, &pool);
+
+				std::vector<double> times;
+				for (int i = 0; i < num_runs; i++) {
+					auto start = std::chrono::steady_clock::now();
+					if (run_session(session, &input, &output, &pool) != 0) break;
+					times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+				}
+
+				if (!times.empty()) {
+					std::sort(times.begin(), times.end());
+					double median = times[times.size() / 2];
+					fprintf(stdout, "Session intra %d inter %d per session threads %d: %.1f us\n",
+						candidate.intra_op_threads, candidate.inter_op_threads, int(candidate.use_per_session_threads), median);
+
+					if (best_time < 0 || median < best_time) {
+						best_time = median;
+						*best = candidate;
+					}
+				}
+			}
+
+			delete_tensor_pool(&pool);
+			delete_session(session);
+			delete_graph(graph);
+		}
+
+		if (best_time < 0) {
+			fprintf(stderr, "ERROR: Unable to tune session\n");
+			return -1;
+		}
+
+		fprintf(stdout, "Selected session intra %d inter %d per session threads %d\n",
+			best->intra_op_threads, best->inter_op_threads, int(best->use_per_session_threads));
+		return 0;
+	}
+
 	void delete_graph (TF_Graph * graph) {
 		TF_DeleteGraph(graph);
 	}
 
+	int get_tensor_shape (TF_Graph * graph, const TF_Output * tensor, std::vector<std::int64_t>& dims) {
+		TF_Status * status = TF_NewStatus();
+		int num_dims = TF_GraphGetTensorNumDims(graph, *tensor, status);
+		if (TF_GetCode(status) != TF_OK || num_dims < 0) {
+			fprintf(stderr, "ERROR: Unable to get tensor shape %s\n", TF_Message(status));
+			TF_DeleteStatus(status);
+			return -1;
+		}
+
+		dims.assign(num_dims, -1);
+		TF_GraphGetTensorShape(graph, *tensor, dims.data(), num_dims, status);
+		if (TF_GetCode(status) != TF_OK) {
+			fprintf(stderr, "ERROR: Unable to get tensor shape %s\n", TF_Message(status));
+			TF_DeleteStatus(status);
+			return -1;
+		}
+		TF_DeleteStatus(status);
+
+		return 0;
+	}
+
 	int delete_session (TF_Session * session) {
 		TF_Status * status = TF_NewStatus();
 		TF_CloseSession(session, status);
@@ -122,4 +257,56 @@ namespace tf_functions {
 	void delete_tensor(TF_Tensor * tensor) {
 		TF_DeleteTensor(tensor);
 	}
+
+
+	int create_tensor_pool (TF_DataType data_type, const std::int64_t * dims, std::size_t num_dims, tensor_pool * pool) {
+		delete_tensor_pool(pool);
+
+		// Zero-filled input, written in place by the caller before every run
+		if (create_tensor(data_type, dims, num_dims, nullptr, &pool->input_tensor) != 0) {
+			fprintf(stderr, "ERROR: Unable to allocate input tensor\n");
+			return -1;
+		}
+		std::memset(TF_TensorData(pool->input_tensor), 0, TF_TensorByteSize(pool->input_tensor));
+
+		// The model gives at most one output per input time step
+		std::size_t max_outputs = 1;
+		for (std::size_t i = 0; i < num_dims; i++) max_outputs *= dims[i];
+		pool->output_data.assign(max_outputs, 0.f);
+		pool->output_size = 0;
+
+		return 0;
+	}
+
+	void * tensor_pool_input (tensor_pool * pool) {
+		return pool->input_tensor ? TF_TensorData(pool->input_tensor) : nullptr;
+	}
+
+	int run_session (TF_Session * session, const TF_Output * input_operation, const TF_Output * output_operation, tensor_pool * pool) {
+		TF_Tensor * output_tensor = nullptr;
+
+		// The C API always hands back a freshly allocated output tensor, so its values are copied
+		// into the pool storage (sized at creation) and the tensor is released at once
+		if (run_session(session, input_operation, &pool->input_tensor, 1, output_operation, &output_tensor, 1) != 0) {
+			return -1;
+		}
+
+		const float * data = static_cast<const float*>(TF_TensorData(output_tensor));
+		std::size_t len = std::min(TF_TensorByteSize(output_tensor) / sizeof(float), pool->output_data.size());
+		std::copy(data, data + len, pool->output_data.begin());
+		pool->output_size = len;
+
+		delete_tensor(output_tensor);
+
+		return 0;
+	}
+
+	void delete_tensor_pool (tensor_pool * pool) {
+		if (pool->input_tensor != nullptr) {
+			delete_tensor(pool->input_tensor);
+			pool->input_tensor = nullptr;
+		}
+		pool->output_data.clear();
+		pool->output_size = 0;
+	}
 }
@@ -3,10 +3,30 @@
 #include <tensorflow/c/c_api.h> // TensorFlow C API header.
  
 namespace tf_functions {
+	// Subset of tensorflow::ConfigProto used to create the session
+	struct session_options {
+		int intra_op_threads = 1;           // Threads used inside a single op
+		int inter_op_threads = 1;           // Ops run in parallel
+		int device_count = 1;               // Number of CPU devices
+		bool use_per_session_threads = false; // Own thread pools instead of the process-wide ones
+	};
+
+	// Serialized ConfigProto for TF_SetConfig
+	std::vector<std::uint8_t> encode_config (const session_options& options);
+
 	int load_session (const char * model_path, TF_Graph ** graph, TF_Session ** session);
 
+	int load_session (const char * model_path, TF_Graph ** graph, TF_Session ** session, const session_options& options);
+
+	// Benchmarks a few threading configurations on a zero input of the given dims and stores the fastest in best
+	int tune_session (const char * model_path, const char * input_name, const char * output_name,
+		const std::int64_t * dims, std::size_t num_dims, int num_runs, session_options * best);
+
 	void delete_graph (TF_Graph * graph);
 
+	// Static shape of a graph tensor, unknown dimensions are -1
+	int get_tensor_shape (TF_Graph * graph, const TF_Output * tensor, std::vector<std::int64_t>& dims);
+
 	int delete_session (TF_Session * session);
 
 	int run_session (TF_Session * session,
@@ -30,5 +50,27 @@ namespace tf_functions {
 
 	void delete_tensor(TF_Tensor * tensor);
 
+
+	// Input tensor allocated once and reused by every prediction, plus persistent storage for the outputs
+	struct tensor_pool {
+		TF_Tensor * input_tensor = nullptr;
+		std::vector<float> output_data;
+		std::size_t output_size = 0; // Values written by the last run
+	};
+
+	int create_tensor_pool (TF_DataType data_type, const std::int64_t * dims, std::size_t num_dims, tensor_pool * pool);
+
+	inline int create_tensor_pool (TF_DataType data_type, const std::vector<std::int64_t>& dims, std::size_t num_dims, tensor_pool * pool) {
+		return create_tensor_pool(data_type, dims.data(), num_dims, pool);
+	}
+
+	// Pointer to the input tensor memory, so windows can be written in place
+	void * tensor_pool_input (tensor_pool * pool);
+
+	// Runs the session on the pool input and copies the (first) output into pool->output_data,
+	// setting pool->output_size
+	int run_session (TF_Session * session, const TF_Output * input_operation, const TF_Output * output_operation, tensor_pool * pool);
+
+	void delete_tensor_pool (tensor_pool * pool);
 	
 }
\ No newline at end of file
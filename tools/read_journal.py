@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Converts a CNN-ripple detection journal to CSV or NumPy.
+
+The journal is a 64-byte header followed by a ring of 24-byte records, see Source/DetectionJournal.h.
+Records are written in order, so once the ring has wrapped the oldest ones have been overwritten.
+
+    python3 read_journal.py CNN-ripple_2024-01-01_12-00-00.journal            # CSV to stdout
+    python3 read_journal.py session.journal -o detections.csv
+    python3 read_journal.py session.journal -o detections.npy                # structured array, needs NumPy
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"CNNRJNL1"
+HEADER = struct.Struct("<8sIIQdQ24x")
+RECORD = struct.Struct("<qifff")
+FIELDS = ("timestamp", "line", "probability", "drift", "latency_us")
+
+
+def read_journal(path):
+    """Returns (sample rate, records oldest first, records lost to the ring wrapping)"""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, header_size, record_size, capacity, sample_rate, count = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("%s is not a detection journal" % path)
+    if record_size != RECORD.size:
+        raise ValueError("Unsupported record size %d" % record_size)
+
+    first = max(0, count - capacity)
+    records = []
+    for index in range(first, count):
+        records.append(RECORD.unpack_from(data, header_size + (index % capacity) * record_size))
+    return sample_rate, records, first
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a CNN-ripple detection journal to CSV or NumPy")
+    parser.add_argument("journal")
+    parser.add_argument("-o", "--output", help=".csv or .npy file, CSV to stdout if omitted")
+    args = parser.parse_args()
+
+    sample_rate, records, lost = read_journal(args.journal)
+    if lost > 0:
+        print("%d oldest detections were overwritten" % lost, file=sys.stderr)
+
+    if args.output and args.output.endswith(".npy"):
+        import numpy as np
+        dtype = np.dtype([("timestamp", "<i8"), ("line", "<i4"), ("probability", "<f4"), ("drift", "<f4"),
+                          ("latency_us", "<f4"), ("time_s", "<f8")])
+        array = np.array([r + (r[0] / sample_rate,) for r in records], dtype=dtype)
+        np.save(args.output, array)
+        return
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    out.write(",".join(FIELDS + ("time_s",)) + "\n")
+    for r in records:
+        out.write("%d,%d,%.6f,%.6f,%.1f,%.6f\n" % (r + (r[0] / sample_rate,)))
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()